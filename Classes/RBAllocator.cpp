@@ -0,0 +1,263 @@
+//
+//  RBAllocator.cpp
+//  rayne-bullet
+//
+//  Copyright 2013 by Überpixel. All rights reserved.
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "RBAllocator.h"
+
+#define kRBAllocatorHeaderSize 16
+#define kRBAllocatorSmallestClass 32
+
+namespace RN
+{
+	namespace bullet
+	{
+		struct AllocatorBlockHeader
+		{
+			AllocatorArena *arena;
+			uint32 sizeClass;
+			uint32 offset;
+		};
+		
+		static_assert(sizeof(AllocatorBlockHeader) <= kRBAllocatorHeaderSize, "Block header must fit in front of a 16 byte aligned block");
+		
+		static bool _allocatorInstalled = false;
+		static size_t _allocatorChunkSize = 0;
+		static AllocatorArena *_defaultArena = nullptr;
+		static thread_local AllocatorArena *_currentArena = nullptr;
+		
+		static inline size_t AllocatorClassSize(uint32 sizeClass)
+		{
+			return static_cast<size_t>(kRBAllocatorSmallestClass) << sizeClass;
+		}
+		
+		AllocatorArena::AllocatorArena(size_t chunkSize) :
+			_chunkSize(chunkSize),
+			_destroyed(false),
+			_blocksInUse(0),
+			_statistics()
+		{
+			std::fill(_freeLists, _freeLists + SizeClasses, nullptr);
+		}
+		
+		AllocatorArena::~AllocatorArena()
+		{
+			for(uint8 *chunk : _chunks)
+				free(chunk);
+		}
+		
+		void AllocatorArena::Destroy()
+		{
+			_lock.lock();
+			
+			_destroyed = true;
+			bool empty = (_blocksInUse == 0);
+			
+			_lock.unlock();
+			
+			if(empty)
+				delete this;
+		}
+		
+		void AllocatorArena::AllocateChunk(uint32 sizeClass)
+		{
+			size_t size = AllocatorClassSize(sizeClass);
+			size_t count = std::max<size_t>(_chunkSize / size, 1);
+			
+			uint8 *chunk = static_cast<uint8 *>(malloc(count * size + kRBAllocatorHeaderSize));
+			_chunks.push_back(chunk);
+			
+			// malloc() only guarantees 8 byte alignment on some platforms
+			uint8 *data = reinterpret_cast<uint8 *>((reinterpret_cast<uintptr_t>(chunk) + (kRBAllocatorHeaderSize - 1)) & ~static_cast<uintptr_t>(kRBAllocatorHeaderSize - 1));
+			
+			for(size_t i = 0; i < count; i ++)
+			{
+				Block *block = reinterpret_cast<Block *>(data + i * size);
+				block->next = _freeLists[sizeClass];
+				
+				_freeLists[sizeClass] = block;
+			}
+			
+			_statistics.bytesReserved += count * size + kRBAllocatorHeaderSize;
+		}
+		
+		void *AllocatorArena::Allocate(size_t size, size_t alignment)
+		{
+			size_t required = size + kRBAllocatorHeaderSize;
+			
+			uint32 sizeClass = 0;
+			while(sizeClass < SizeClasses && AllocatorClassSize(sizeClass) < required)
+				sizeClass ++;
+			
+			std::lock_guard<std::mutex> lock(_lock);
+			
+			_blocksInUse ++;
+			_statistics.stepAllocations ++;
+			_statistics.stepBytes += size;
+			_statistics.bytesInUse += size;
+			
+			if(sizeClass == SizeClasses || alignment > kRBAllocatorHeaderSize)
+			{
+				alignment = std::max<size_t>(alignment, kRBAllocatorHeaderSize);
+				
+				// The size is kept at the start of the raw allocation, in front of the header
+				uint8 *raw = static_cast<uint8 *>(malloc(size + alignment + 2 * kRBAllocatorHeaderSize));
+				uint8 *data = reinterpret_cast<uint8 *>((reinterpret_cast<uintptr_t>(raw) + 2 * kRBAllocatorHeaderSize + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1));
+				
+				*reinterpret_cast<size_t *>(raw) = size;
+				
+				AllocatorBlockHeader *header = reinterpret_cast<AllocatorBlockHeader *>(data - kRBAllocatorHeaderSize);
+				header->arena = this;
+				header->sizeClass = HeapClass;
+				header->offset = static_cast<uint32>(data - raw);
+				
+				return data;
+			}
+			
+			if(!_freeLists[sizeClass])
+				AllocateChunk(sizeClass);
+			
+			Block *block = _freeLists[sizeClass];
+			_freeLists[sizeClass] = block->next;
+			
+			AllocatorBlockHeader *header = reinterpret_cast<AllocatorBlockHeader *>(block);
+			header->arena = this;
+			header->sizeClass = sizeClass;
+			header->offset = static_cast<uint32>(size);
+			
+			return reinterpret_cast<uint8 *>(block) + kRBAllocatorHeaderSize;
+		}
+		
+		void AllocatorArena::Free(void *pointer)
+		{
+			uint8 *data = static_cast<uint8 *>(pointer);
+			AllocatorBlockHeader *header = reinterpret_cast<AllocatorBlockHeader *>(data - kRBAllocatorHeaderSize);
+			
+			_lock.lock();
+			
+			if(header->sizeClass == HeapClass)
+			{
+				uint8 *raw = data - header->offset;
+				_statistics.bytesInUse -= *reinterpret_cast<size_t *>(raw);
+				
+				free(raw);
+			}
+			else
+			{
+				_statistics.bytesInUse -= header->offset;
+				
+				Block *block = reinterpret_cast<Block *>(header);
+				block->next = _freeLists[header->sizeClass];
+				
+				_freeLists[header->sizeClass] = block;
+			}
+			
+			_blocksInUse --;
+			bool release = (_destroyed && _blocksInUse == 0);
+			
+			_lock.unlock();
+			
+			if(release)
+				delete this;
+		}
+		
+		void AllocatorArena::ResetStepCounters()
+		{
+			std::lock_guard<std::mutex> lock(_lock);
+			
+			_statistics.stepAllocations = 0;
+			_statistics.stepBytes = 0;
+		}
+		
+		AllocatorArena::Statistics AllocatorArena::GetStatistics()
+		{
+			std::lock_guard<std::mutex> lock(_lock);
+			return _statistics;
+		}
+		
+		static void *AllocatorAlignedAllocate(size_t size, int alignment)
+		{
+			AllocatorArena *arena = _currentArena ? _currentArena : _defaultArena;
+			return arena->Allocate(size, static_cast<size_t>(alignment));
+		}
+		
+		static void *AllocatorAllocate(size_t size)
+		{
+			return AllocatorAlignedAllocate(size, kRBAllocatorHeaderSize);
+		}
+		
+		static void AllocatorFree(void *pointer)
+		{
+			if(!pointer)
+				return;
+			
+			AllocatorBlockHeader *header = reinterpret_cast<AllocatorBlockHeader *>(static_cast<uint8 *>(pointer) - kRBAllocatorHeaderSize);
+			header->arena->Free(pointer);
+		}
+		
+		void Allocator::Install(size_t chunkSize)
+		{
+			if(_allocatorInstalled)
+				return;
+			
+			_allocatorChunkSize = chunkSize;
+			_defaultArena = new AllocatorArena(chunkSize);
+			_allocatorInstalled = true;
+			
+			btAlignedAllocSetCustom(&AllocatorAllocate, &AllocatorFree);
+			btAlignedAllocSetCustomAligned(&AllocatorAlignedAllocate, &AllocatorFree);
+		}
+		
+		bool Allocator::IsInstalled()
+		{
+			return _allocatorInstalled;
+		}
+		
+		AllocatorArena *Allocator::CreateArena()
+		{
+			if(!_allocatorInstalled)
+				return nullptr;
+			
+			return new AllocatorArena(_allocatorChunkSize);
+		}
+		
+		AllocatorArena *Allocator::GetDefaultArena()
+		{
+			return _defaultArena;
+		}
+		
+		AllocatorArena *Allocator::GetCurrentArena()
+		{
+			return _currentArena;
+		}
+		
+		void Allocator::SetCurrentArena(AllocatorArena *arena)
+		{
+			_currentArena = arena;
+		}
+		
+		AllocatorScope::AllocatorScope(AllocatorArena *arena) :
+			_previous(_currentArena)
+		{
+			if(arena)
+				_currentArena = arena;
+		}
+		
+		AllocatorScope::~AllocatorScope()
+		{
+			_currentArena = _previous;
+		}
+	}
+}
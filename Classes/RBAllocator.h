@@ -0,0 +1,103 @@
+//
+//  RBAllocator.h
+//  rayne-bullet
+//
+//  Copyright 2013 by Überpixel. All rights reserved.
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef __rayne_bullet__RBAllocator__
+#define __rayne_bullet__RBAllocator__
+
+#include <Rayne/Rayne.h>
+#include <btBulletDynamicsCommon.h>
+
+namespace RN
+{
+	namespace bullet
+	{
+		class AllocatorArena
+		{
+		public:
+			struct Statistics
+			{
+				size_t stepAllocations;
+				size_t stepBytes;
+				size_t bytesInUse;
+				size_t bytesReserved;
+			};
+			
+			AllocatorArena(size_t chunkSize);
+			
+			// Frees all chunks at once, deferred until blocks still held outside of the world are returned
+			void Destroy();
+			
+			void *Allocate(size_t size, size_t alignment);
+			void Free(void *pointer);
+			
+			void ResetStepCounters();
+			Statistics GetStatistics();
+			
+		private:
+			enum
+			{
+				SizeClasses = 8,
+				HeapClass = 0xffffffff
+			};
+			
+			struct Block
+			{
+				Block *next;
+			};
+			
+			~AllocatorArena();
+			
+			void AllocateChunk(uint32 sizeClass);
+			
+			std::mutex _lock;
+			size_t _chunkSize;
+			bool _destroyed;
+			
+			Block *_freeLists[SizeClasses];
+			std::vector<uint8 *> _chunks;
+			
+			size_t _blocksInUse;
+			Statistics _statistics;
+		};
+		
+		class Allocator
+		{
+		public:
+			// Routes all Bullet allocations through pooled arenas, must be called before any Bullet object is created
+			static void Install(size_t chunkSize = 64 * 1024);
+			static bool IsInstalled();
+			
+			static AllocatorArena *CreateArena();
+			static AllocatorArena *GetDefaultArena();
+			
+			static AllocatorArena *GetCurrentArena();
+			static void SetCurrentArena(AllocatorArena *arena);
+		};
+		
+		class AllocatorScope
+		{
+		public:
+			AllocatorScope(AllocatorArena *arena);
+			~AllocatorScope();
+			
+		private:
+			AllocatorArena *_previous;
+		};
+	}
+}
+
+#endif /* defined(__rayne_bullet__RBAllocator__) */
@@ -0,0 +1,318 @@
+//
+//  RBArticulation.cpp
+//  rayne-bullet
+//
+//  Copyright 2013 by Überpixel. All rights reserved.
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "RBArticulation.h"
+#include "RBPhysicsWorld.h"
+
+namespace RN
+{
+	namespace bullet
+	{
+		RNDefineMeta(Articulation, CollisionObject)
+		
+		ArticulationLink::ArticulationLink(Type ttype, int tparent, Shape *tshape, float tmass) :
+			type(ttype),
+			parent(tparent),
+			shape(tshape),
+			mass(tmass),
+			axis(Vector3(1.0f, 0.0f, 0.0f)),
+			disableParentCollision(true),
+			limited(false),
+			lowerLimit(0.0f),
+			upperLimit(0.0f)
+		{}
+		
+		
+		Articulation::Articulation(Shape *baseShape, float baseMass, bool fixedBase, const std::vector<ArticulationLink> &links) :
+			_baseShape(baseShape->Retain()),
+			_links(links)
+		{
+			int count = static_cast<int>(_links.size());
+			
+			Vector3 inertia = _baseShape->CalculateLocalInertia(baseMass);
+			_multiBody = new btMultiBody(count, baseMass, btVector3(inertia.x, inertia.y, inertia.z), fixedBase, true);
+			
+			_baseCollider = new btMultiBodyLinkCollider(_multiBody, -1);
+			_baseCollider->setCollisionShape(_baseShape->GetBulletShape());
+			_baseCollider->setUserPointer(this);
+			_multiBody->setBaseCollider(_baseCollider);
+			
+			_colliders.reserve(count);
+			_limits.reserve(count);
+			
+			for(int i = 0; i < count; i ++)
+			{
+				ArticulationLink &link = _links[i];
+				link.shape->Retain();
+				
+				Vector3 linkInertia = link.shape->CalculateLocalInertia(link.mass);
+				
+				btVector3 btInertia(linkInertia.x, linkInertia.y, linkInertia.z);
+				btQuaternion rotation(link.rotation.x, link.rotation.y, link.rotation.z, link.rotation.w);
+				btVector3 axis(link.axis.x, link.axis.y, link.axis.z);
+				btVector3 pivot(link.pivot.x, link.pivot.y, link.pivot.z);
+				
+				switch(link.type)
+				{
+					case ArticulationLink::Type::Revolute:
+						_multiBody->setupRevolute(i, link.mass, btInertia, link.parent, rotation, axis, btVector3(link.parentPivot.x, link.parentPivot.y, link.parentPivot.z), pivot, link.disableParentCollision);
+						break;
+						
+					case ArticulationLink::Type::Prismatic:
+						_multiBody->setupPrismatic(i, link.mass, btInertia, link.parent, rotation, axis, pivot, link.disableParentCollision);
+						break;
+				}
+				
+				btMultiBodyLinkCollider *collider = new btMultiBodyLinkCollider(_multiBody, i);
+				collider->setCollisionShape(link.shape->GetBulletShape());
+				collider->setUserPointer(this);
+				
+				_multiBody->getLink(i).m_collider = collider;
+				_colliders.push_back(collider);
+				
+				_limits.push_back(link.limited ? new btMultiBodyJointLimitConstraint(_multiBody, i, link.lowerLimit, link.upperLimit) : nullptr);
+			}
+			
+			_motors.resize(count, nullptr);
+			_nodes.resize(count, nullptr);
+			
+			_worldToLocal.resize(count + 1);
+			_localOrigin.resize(count + 1);
+		}
+		
+		Articulation::~Articulation()
+		{
+			for(size_t i = 0; i < _links.size(); i ++)
+			{
+				delete _motors[i];
+				delete _limits[i];
+				delete _colliders[i];
+				
+				SafeRelease(_nodes[i]);
+				_links[i].shape->Release();
+			}
+			
+			delete _baseCollider;
+			delete _multiBody;
+			
+			_baseShape->Release();
+		}
+		
+		Articulation *Articulation::WithLinks(Shape *baseShape, float baseMass, bool fixedBase, const std::vector<ArticulationLink> &links)
+		{
+			Articulation *articulation = new Articulation(baseShape, baseMass, fixedBase, links);
+			return articulation->Autorelease();
+		}
+		
+		
+		void Articulation::SetLinkNode(size_t link, SceneNode *node)
+		{
+			SafeRelease(_nodes[link]);
+			_nodes[link] = SafeRetain(node);
+		}
+		
+		void Articulation::SetJointPosition(size_t link, float position)
+		{
+			_multiBody->setJointPos(static_cast<int>(link), position);
+		}
+		void Articulation::SetJointVelocity(size_t link, float velocity)
+		{
+			_multiBody->setJointVel(static_cast<int>(link), velocity);
+		}
+		
+		void Articulation::SetJointMotor(size_t link, float targetVelocity, float maxImpulse)
+		{
+			RemoveJointMotor(link);
+			
+			// The vendored motor has no setter for its target, so it gets replaced instead
+			_motors[link] = new btMultiBodyJointMotor(_multiBody, static_cast<int>(link), targetVelocity, maxImpulse);
+			
+			PhysicsWorld *owner = GetOwner();
+			if(owner && owner->GetBulletMultiBodyWorld())
+				owner->GetBulletMultiBodyWorld()->addMultiBodyConstraint(_motors[link]);
+		}
+		
+		void Articulation::RemoveJointMotor(size_t link)
+		{
+			if(!_motors[link])
+				return;
+			
+			PhysicsWorld *owner = GetOwner();
+			if(owner && owner->GetBulletMultiBodyWorld())
+				owner->GetBulletMultiBodyWorld()->removeMultiBodyConstraint(_motors[link]);
+			
+			delete _motors[link];
+			_motors[link] = nullptr;
+		}
+		
+		void Articulation::SetLinearDamping(float damping)
+		{
+			_multiBody->setLinearDamping(damping);
+		}
+		
+		void Articulation::AddJointTorque(size_t link, float torque)
+		{
+			_multiBody->addJointTorque(static_cast<int>(link), torque);
+		}
+		
+		float Articulation::GetJointPosition(size_t link) const
+		{
+			return _multiBody->getJointPos(static_cast<int>(link));
+		}
+		float Articulation::GetJointVelocity(size_t link) const
+		{
+			return _multiBody->getJointVel(static_cast<int>(link));
+		}
+		
+		
+		void Articulation::Update(float delta)
+		{
+			if(!GetOwner())
+				return;
+			
+			const btVector3 &position = _multiBody->getBasePos();
+			btQuaternion rotation = _multiBody->getWorldToBaseRot().inverse();
+			
+			Quaternion worldRotation(rotation.x(), rotation.y(), rotation.z(), rotation.w());
+			
+			SetWorldRotation(worldRotation);
+			SetWorldPosition(Vector3(position.x(), position.y(), position.z()) + worldRotation.GetRotatedVector(offset));
+			
+			for(size_t i = 0; i < _nodes.size(); i ++)
+			{
+				if(!_nodes[i])
+					continue;
+				
+				const btTransform &transform = _colliders[i]->getWorldTransform();
+				const btVector3 &linkPosition = transform.getOrigin();
+				btQuaternion linkRotation = transform.getRotation();
+				
+				_nodes[i]->SetWorldPosition(Vector3(linkPosition.x(), linkPosition.y(), linkPosition.z()));
+				_nodes[i]->SetWorldRotation(Quaternion(linkRotation.x(), linkRotation.y(), linkRotation.z(), linkRotation.w()));
+			}
+		}
+		
+		void Articulation::DidUpdate(SceneNode::ChangeSet changeSet)
+		{
+			CollisionObject::DidUpdate(changeSet);
+			
+			if(changeSet & SceneNode::ChangeSet::Position)
+				UpdateBaseFromNode();
+		}
+		
+		void Articulation::UpdateFromMaterial(PhysicsMaterial *material)
+		{
+			SetLinearDamping(material->GetLinearDamping());
+		}
+		
+		
+		void Articulation::UpdateBaseFromNode()
+		{
+			if(!GetParent())
+				return;
+			
+			Quaternion rotation = GetWorldRotation();
+			Vector3 position = GetWorldPosition() - rotation.GetRotatedVector(offset);
+			
+			_multiBody->setBasePos(btVector3(position.x, position.y, position.z));
+			_multiBody->setWorldToBaseRot(btQuaternion(rotation.x, rotation.y, rotation.z, rotation.w).inverse());
+		}
+		
+		void Articulation::UpdateColliderTransforms()
+		{
+			_worldToLocal[0] = _multiBody->getWorldToBaseRot();
+			_localOrigin[0] = _multiBody->getBasePos();
+			
+			_baseCollider->setWorldTransform(btTransform(_worldToLocal[0].inverse(), _localOrigin[0]));
+			
+			for(int i = 0; i < _multiBody->getNumLinks(); i ++)
+			{
+				int parent = _multiBody->getParent(i);
+				
+				_worldToLocal[i + 1] = _multiBody->getParentToLocalRot(i) * _worldToLocal[parent + 1];
+				_localOrigin[i + 1] = _localOrigin[parent + 1] + quatRotate(_worldToLocal[i + 1].inverse(), _multiBody->getRVector(i));
+				
+				_colliders[i]->setWorldTransform(btTransform(_worldToLocal[i + 1].inverse(), _localOrigin[i + 1]));
+			}
+		}
+		
+		
+		bool Articulation::CanInsertIntoWorld(PhysicsWorld *world) const
+		{
+			// Articulations can only be simulated by worlds created in articulated mode
+			return world->IsArticulated();
+		}
+		
+		void Articulation::InsertIntoWorld(PhysicsWorld *world)
+		{
+			btMultiBodyDynamicsWorld *bulletWorld = world->GetBulletMultiBodyWorld();
+			if(!bulletWorld)
+				return;
+			
+			CollisionObject::InsertIntoWorld(world);
+			
+			UpdateBaseFromNode();
+			UpdateColliderTransforms();
+			
+			bulletWorld->addMultiBody(_multiBody, GetCollisionFilter(), GetCollisionFilterMask());
+			bulletWorld->addCollisionObject(_baseCollider, GetCollisionFilter(), GetCollisionFilterMask());
+			
+			for(size_t i = 0; i < _colliders.size(); i ++)
+			{
+				_colliders[i]->setCollisionFlags(_colliders[i]->getCollisionFlags() | btCollisionObject::CF_CUSTOM_MATERIAL_CALLBACK);
+				bulletWorld->addCollisionObject(_colliders[i], GetCollisionFilter(), GetCollisionFilterMask());
+				
+				if(_limits[i])
+					bulletWorld->addMultiBodyConstraint(_limits[i]);
+				
+				if(_motors[i])
+					bulletWorld->addMultiBodyConstraint(_motors[i]);
+			}
+		}
+		
+		void Articulation::RemoveFromWorld(PhysicsWorld *world)
+		{
+			btMultiBodyDynamicsWorld *bulletWorld = world->GetBulletMultiBodyWorld();
+			if(!bulletWorld)
+				return;
+			
+			CollisionObject::RemoveFromWorld(world);
+			
+			for(size_t i = 0; i < _colliders.size(); i ++)
+			{
+				if(_motors[i])
+					bulletWorld->removeMultiBodyConstraint(_motors[i]);
+				
+				if(_limits[i])
+					bulletWorld->removeMultiBodyConstraint(_limits[i]);
+				
+				bulletWorld->removeCollisionObject(_colliders[i]);
+			}
+			
+			bulletWorld->removeCollisionObject(_baseCollider);
+			bulletWorld->removeMultiBody(_multiBody);
+		}
+		
+		void Articulation::UpdateCollisionFilter(PhysicsWorld *world)
+		{
+			CollisionObject::UpdateCollisionFilter(world);
+			
+			for(btMultiBodyLinkCollider *collider : _colliders)
+				world->UpdateCollisionFilter(collider, GetCollisionFilter(), GetCollisionFilterMask());
+		}
+	}
+}
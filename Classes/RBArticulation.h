@@ -0,0 +1,120 @@
+//
+//  RBArticulation.h
+//  rayne-bullet
+//
+//  Copyright 2013 by Überpixel. All rights reserved.
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef __rayne_bullet__RBArticulation__
+#define __rayne_bullet__RBArticulation__
+
+#include <Rayne/Rayne.h>
+#include <BulletDynamics/Featherstone/btMultiBody.h>
+#include <BulletDynamics/Featherstone/btMultiBodyLinkCollider.h>
+#include <BulletDynamics/Featherstone/btMultiBodyJointMotor.h>
+#include <BulletDynamics/Featherstone/btMultiBodyJointLimitConstraint.h>
+#include "RBCollisionObject.h"
+#include "RBShape.h"
+
+namespace RN
+{
+	namespace bullet
+	{
+		struct ArticulationLink
+		{
+			enum class Type
+			{
+				Revolute,
+				Prismatic
+			};
+			
+			ArticulationLink(Type type, int parent, Shape *shape, float mass);
+			
+			Type type;
+			int parent; // -1 for the base
+			Shape *shape;
+			float mass;
+			
+			// Rotation from the parent frame into the link frame when the joint is at zero
+			Quaternion rotation;
+			// Joint axis in the link frame
+			Vector3 axis;
+			// Revolute: parent center of mass to the joint in the parent frame, prismatic: unused
+			Vector3 parentPivot;
+			// Revolute: joint to the link center of mass in the link frame, prismatic: parent to link center of mass in the link frame
+			Vector3 pivot;
+			
+			bool disableParentCollision;
+			bool limited;
+			float lowerLimit;
+			float upperLimit;
+		};
+		
+		class Articulation : public CollisionObject
+		{
+		public:
+			Articulation(Shape *baseShape, float baseMass, bool fixedBase, const std::vector<ArticulationLink> &links);
+			~Articulation() override;
+			
+			static Articulation *WithLinks(Shape *baseShape, float baseMass, bool fixedBase, const std::vector<ArticulationLink> &links);
+			
+			void SetLinkNode(size_t link, SceneNode *node);
+			void SetJointPosition(size_t link, float position);
+			void SetJointVelocity(size_t link, float velocity);
+			void SetJointMotor(size_t link, float targetVelocity, float maxImpulse);
+			void RemoveJointMotor(size_t link);
+			void SetLinearDamping(float damping);
+			
+			void AddJointTorque(size_t link, float torque);
+			
+			float GetJointPosition(size_t link) const;
+			float GetJointVelocity(size_t link) const;
+			size_t GetLinkCount() const { return _links.size(); }
+			
+			void Update(float delta) override;
+			
+			btCollisionObject *GetBulletCollisionObject() override { return _baseCollider; }
+			btMultiBody *GetBulletMultiBody() { return _multiBody; }
+			
+		protected:
+			void DidUpdate(SceneNode::ChangeSet changeSet) override;
+			void UpdateFromMaterial(PhysicsMaterial *material) override;
+			
+			bool CanInsertIntoWorld(PhysicsWorld *world) const override;
+			void InsertIntoWorld(PhysicsWorld *world) override;
+			void RemoveFromWorld(PhysicsWorld *world) override;
+			void UpdateCollisionFilter(PhysicsWorld *world) override;
+			
+		private:
+			void UpdateBaseFromNode();
+			void UpdateColliderTransforms();
+			
+			Shape *_baseShape;
+			btMultiBody *_multiBody;
+			btMultiBodyLinkCollider *_baseCollider;
+			
+			std::vector<ArticulationLink> _links;
+			std::vector<btMultiBodyLinkCollider *> _colliders;
+			std::vector<btMultiBodyJointLimitConstraint *> _limits;
+			std::vector<btMultiBodyJointMotor *> _motors;
+			std::vector<SceneNode *> _nodes;
+			
+			btAlignedObjectArray<btQuaternion> _worldToLocal;
+			btAlignedObjectArray<btVector3> _localOrigin;
+			
+			RNDeclareMeta(Articulation)
+		};
+	}
+}
+
+#endif /* defined(__rayne_bullet__RBArticulation__) */
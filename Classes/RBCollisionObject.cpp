@@ -27,42 +27,58 @@ namespace RN
 		CollisionObject::CollisionObject() :
 			_collisionFilter(btBroadphaseProxy::DefaultFilter),
 			_collisionFilterMask(btBroadphaseProxy::AllFilter),
+			_collisionLayer(0),
+			_materialIndex(PhysicsWorld::NoMaterial),
+			_sleeping(false),
 			_owner(nullptr),
 			_material(nullptr)
 		{}
 		
 		CollisionObject::~CollisionObject()
 		{
-			if(_material)
-			{
-				_connection->Disconnect();
-				_material->Release();
-			}
+			SafeRelease(_material);
 		}
 		
 		
 		void CollisionObject::SetCollisionFilter(short int filter)
 		{
 			_collisionFilter = filter;
-			ReInsertIntoWorld();
+			
+			if(_owner)
+				UpdateCollisionFilter(_owner);
 		}
 		void CollisionObject::SetCollisionFilterMask(short int mask)
 		{
 			_collisionFilterMask = mask;
-			ReInsertIntoWorld();
+			
+			if(_owner)
+				UpdateCollisionFilter(_owner);
+		}
+		void CollisionObject::SetCollisionLayer(uint32 layer)
+		{
+			if(layer >= PhysicsWorld::MaxLayers)
+				return;
+			
+			_collisionLayer = layer;
+			
+			if(_owner)
+				UpdateCollisionFilter(_owner);
 		}
 		void CollisionObject::SetMaterial(PhysicsMaterial *tmaterial)
 		{
-			if(_material)
-			{
-				_connection->Disconnect();
-				_material->Release();
-			}
+			SafeRelease(_material);
 			
+			// Later changes to the material reach the object through its world's material slot
 			if((_material = SafeRetain(tmaterial)))
-			{
-				_connection = _material->signal.Connect(std::bind(&CollisionObject::UpdateFromMaterial, this, std::placeholders::_1));
 				UpdateFromMaterial(_material);
+			
+			if(_owner)
+			{
+				uint32 index = _materialIndex;
+				_materialIndex = _material ? _owner->RegisterMaterial(_material) : PhysicsWorld::NoMaterial;
+				
+				if(index != PhysicsWorld::NoMaterial)
+					_owner->UnregisterMaterial(index);
 			}
 		}
 		
@@ -89,13 +105,34 @@ namespace RN
 			}
 		}
 		
+		SceneNode *CollisionObject::GetHitNode(int part, int index) const
+		{
+			return GetParent();
+		}
+		
+		void CollisionObject::UpdateCollisionFilter(PhysicsWorld *world)
+		{
+			world->UpdateCollisionFilter(GetBulletCollisionObject(), _collisionFilter, _collisionFilterMask);
+		}
+		
 		void CollisionObject::InsertIntoWorld(PhysicsWorld *world)
 		{
 			_owner = world;
+			
+			// Friction and restitution are resolved at contact time from the material table of the world
+			_materialIndex = _material ? world->RegisterMaterial(_material) : PhysicsWorld::NoMaterial;
+			
+			if(_material)
+				UpdateFromMaterial(_material);
+			GetBulletCollisionObject()->setCollisionFlags(GetBulletCollisionObject()->getCollisionFlags() | btCollisionObject::CF_CUSTOM_MATERIAL_CALLBACK);
 		}
 		void CollisionObject::RemoveFromWorld(PhysicsWorld *world)
 		{
+			if(_materialIndex != PhysicsWorld::NoMaterial)
+				world->UnregisterMaterial(_materialIndex);
+			
 			_owner = nullptr;
+			_materialIndex = PhysicsWorld::NoMaterial;
 		}
 		
 		
@@ -105,24 +142,40 @@ namespace RN
 			{
 				World *world = GetParent()->GetWorld();
 				
-				if(!world && _owner)
+				if(!world)
 				{
-					_owner->RemoveCollisionObject(this);
+					if(_owner)
+						_owner->RemoveCollisionObject(this);
+					
 					return;
 				}
 				
-				if(world && !_owner)
-				{
-					PhysicsWorld::GetSharedInstance()->InsertCollisionObject(this);
+				// Moves the object over when its node changes to a scene with another physics world
+				PhysicsWorld *physicsWorld = PhysicsWorld::GetPhysicsWorld(world);
+				if(physicsWorld == _owner)
 					return;
-				}
+				
+				if(_owner)
+					_owner->RemoveCollisionObject(this);
+				
+				if(physicsWorld)
+					physicsWorld->InsertCollisionObject(this);
 			}
 		}
 		
 		void CollisionObject::DidAddToParent()
 		{
-			if(!_owner)
-				PhysicsWorld::GetSharedInstance()->InsertCollisionObject(this);
+			if(_owner)
+				return;
+			
+			// Nodes outside of a scene join a physics world once their scene is set
+			World *scene = GetParent()->GetWorld();
+			if(!scene)
+				return;
+			
+			PhysicsWorld *world = PhysicsWorld::GetPhysicsWorld(scene);
+			if(world)
+				world->InsertCollisionObject(this);
 		}
 		
 		void CollisionObject::WillRemoveFromParent()
@@ -38,13 +38,17 @@ namespace RN
 			
 			void SetCollisionFilter(short int filter);
 			void SetCollisionFilterMask(short int mask);
+			void SetCollisionLayer(uint32 layer);
 			void SetMaterial(PhysicsMaterial *material);
 			void SetContactCallback(std::function<void(CollisionObject *)> &&callback);
 			void SetPositionOffset(RN::Vector3 offset);
 			
 			short int GetCollisionFilter() const { return _collisionFilter; }
 			short int GetCollisionFilterMask() const { return _collisionFilterMask; }
+			uint32 GetCollisionLayer() const { return _collisionLayer; }
 			PhysicsMaterial *GetMaterial() const { return _material; }
+			PhysicsWorld *GetOwner() const { return _owner; }
+			bool HasContactCallback() const { return static_cast<bool>(_callback); }
 			
 			virtual btCollisionObject *GetBulletCollisionObject() = 0;
 			
@@ -54,13 +58,15 @@ namespace RN
 			void WillRemoveFromParent() override;
 			
 			void ReInsertIntoWorld();
+			virtual SceneNode *GetHitNode(int part, int index) const;
+			virtual void UpdateCollisionFilter(PhysicsWorld *world);
 			virtual void UpdateFromMaterial(PhysicsMaterial *material) = 0;
+			virtual bool CanInsertIntoWorld(PhysicsWorld *world) const { return true; }
 			virtual void InsertIntoWorld(PhysicsWorld *world);
 			virtual void RemoveFromWorld(PhysicsWorld *world);
 			Vector3 offset;
 			
 		private:
-			Connection *_connection;
 			PhysicsWorld *_owner;
 			PhysicsMaterial *_material;
 			
@@ -68,6 +74,9 @@ namespace RN
 			
 			short int _collisionFilter;
 			short int _collisionFilterMask;
+			uint32 _collisionLayer;
+			uint32 _materialIndex;
+			bool _sleeping;
 			
 			RNDeclareMeta(CollisionObject)
 		};
@@ -0,0 +1,286 @@
+//
+//  RBConstraint.cpp
+//  rayne-bullet
+//
+//  Copyright 2013 by Überpixel. All rights reserved.
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "RBConstraint.h"
+#include "RBPhysicsWorld.h"
+
+namespace RN
+{
+	namespace bullet
+	{
+		RNDefineMeta(Constraint, Object)
+		RNDefineMeta(FixedConstraint, Constraint)
+		RNDefineMeta(HingeConstraint, Constraint)
+		RNDefineMeta(ConeTwistConstraint, Constraint)
+		RNDefineMeta(SliderConstraint, Constraint)
+		RNDefineMeta(GenericSpringConstraint, Constraint)
+		
+		Constraint::Constraint(RigidBody *bodyA, RigidBody *bodyB) :
+			_constraint(nullptr),
+			_bodyA(bodyA->Retain()),
+			_bodyB(bodyB->Retain()),
+			_owner(nullptr),
+			_broken(false),
+			_userDisabled(false),
+			_disableCollisions(true)
+		{}
+		
+		Constraint::~Constraint()
+		{
+			delete _constraint;
+			
+			_bodyA->Release();
+			_bodyB->Release();
+		}
+		
+		
+		btTransform Constraint::MakeTransform(const Vector3 &position, const Quaternion &rotation)
+		{
+			btTransform transform;
+			transform.setRotation(btQuaternion(rotation.x, rotation.y, rotation.z, rotation.w));
+			transform.setOrigin(btVector3(position.x, position.y, position.z));
+			
+			return transform;
+		}
+		
+		
+		void Constraint::SetEnabled(bool enabled)
+		{
+			_constraint->setEnabled(enabled);
+			_userDisabled = !enabled;
+			
+			if(enabled)
+				_broken = false;
+		}
+		void Constraint::SetBreakingImpulseThreshold(float threshold)
+		{
+			_constraint->setBreakingImpulseThreshold(threshold);
+			
+			// Bullet only stores the applied impulse with feedback enabled
+			if(threshold < SIMD_INFINITY)
+				_constraint->enableFeedback(true);
+		}
+		void Constraint::SetFeedbackEnabled(bool enabled)
+		{
+			_constraint->enableFeedback(enabled);
+		}
+		void Constraint::SetSolverIterations(int iterations)
+		{
+			_constraint->setOverrideNumSolverIterations(iterations);
+		}
+		void Constraint::SetBreakCallback(std::function<void (Constraint *)> &&callback)
+		{
+			_callback = std::move(callback);
+		}
+		void Constraint::SetDisableCollisionsBetweenBodies(bool disable)
+		{
+			if(_disableCollisions == disable)
+				return;
+			
+			_disableCollisions = disable;
+			
+			if(_owner)
+			{
+				PhysicsWorld *world = _owner;
+				
+				world->Lock();
+				world->RemoveConstraint(this);
+				world->InsertConstraint(this);
+				world->Unlock();
+			}
+		}
+		
+		
+		bool Constraint::IsEnabled() const
+		{
+			return _constraint->isEnabled();
+		}
+		bool Constraint::IsBreakable() const
+		{
+			return (_constraint->getBreakingImpulseThreshold() < SIMD_INFINITY);
+		}
+		float Constraint::GetBreakingImpulseThreshold() const
+		{
+			return _constraint->getBreakingImpulseThreshold();
+		}
+		float Constraint::GetAppliedImpulse() const
+		{
+			return _constraint->needsFeedback() ? _constraint->getAppliedImpulse() : 0.0f;
+		}
+		int Constraint::GetSolverIterations() const
+		{
+			return _constraint->getOverrideNumSolverIterations();
+		}
+		
+		
+		bool Constraint::CheckBroken()
+		{
+			// The solver disables constraints whose applied impulse exceeds the breaking threshold,
+			// constraints disabled through SetEnabled() are not considered broken
+			if(_broken || _userDisabled || _constraint->isEnabled())
+				return false;
+			
+			_broken = true;
+			return true;
+		}
+		
+		void Constraint::InsertIntoWorld(PhysicsWorld *world)
+		{
+			_owner = world;
+			
+			auto bulletWorld = world->GetBulletDynamicsWorld();
+			bulletWorld->addConstraint(_constraint, _disableCollisions);
+		}
+		
+		void Constraint::RemoveFromWorld(PhysicsWorld *world)
+		{
+			_owner = nullptr;
+			
+			auto bulletWorld = world->GetBulletDynamicsWorld();
+			bulletWorld->removeConstraint(_constraint);
+		}
+		
+		
+		
+		FixedConstraint::FixedConstraint(RigidBody *bodyA, const Vector3 &pivotA, const Quaternion &rotationA, RigidBody *bodyB, const Vector3 &pivotB, const Quaternion &rotationB) :
+			Constraint(bodyA, bodyB)
+		{
+			_constraint = new btFixedConstraint(*bodyA->GetBulletRigidBody(), *bodyB->GetBulletRigidBody(), MakeTransform(pivotA, rotationA), MakeTransform(pivotB, rotationB));
+		}
+		
+		FixedConstraint *FixedConstraint::WithBodies(RigidBody *bodyA, const Vector3 &pivotA, const Quaternion &rotationA, RigidBody *bodyB, const Vector3 &pivotB, const Quaternion &rotationB)
+		{
+			FixedConstraint *constraint = new FixedConstraint(bodyA, pivotA, rotationA, bodyB, pivotB, rotationB);
+			return constraint->Autorelease();
+		}
+		
+		
+		HingeConstraint::HingeConstraint(RigidBody *bodyA, const Vector3 &pivotA, const Quaternion &rotationA, RigidBody *bodyB, const Vector3 &pivotB, const Quaternion &rotationB) :
+			Constraint(bodyA, bodyB)
+		{
+			_constraint = new btHingeConstraint(*bodyA->GetBulletRigidBody(), *bodyB->GetBulletRigidBody(), MakeTransform(pivotA, rotationA), MakeTransform(pivotB, rotationB));
+		}
+		
+		HingeConstraint *HingeConstraint::WithBodies(RigidBody *bodyA, const Vector3 &pivotA, const Quaternion &rotationA, RigidBody *bodyB, const Vector3 &pivotB, const Quaternion &rotationB)
+		{
+			HingeConstraint *constraint = new HingeConstraint(bodyA, pivotA, rotationA, bodyB, pivotB, rotationB);
+			return constraint->Autorelease();
+		}
+		
+		void HingeConstraint::SetLimit(float low, float high, float softness)
+		{
+			static_cast<btHingeConstraint *>(_constraint)->setLimit(low, high, softness);
+		}
+		void HingeConstraint::SetMotor(bool enabled, float targetVelocity, float maxImpulse)
+		{
+			static_cast<btHingeConstraint *>(_constraint)->enableAngularMotor(enabled, targetVelocity, maxImpulse);
+		}
+		float HingeConstraint::GetHingeAngle()
+		{
+			return static_cast<btHingeConstraint *>(_constraint)->getHingeAngle();
+		}
+		
+		
+		ConeTwistConstraint::ConeTwistConstraint(RigidBody *bodyA, const Vector3 &pivotA, const Quaternion &rotationA, RigidBody *bodyB, const Vector3 &pivotB, const Quaternion &rotationB) :
+			Constraint(bodyA, bodyB)
+		{
+			_constraint = new btConeTwistConstraint(*bodyA->GetBulletRigidBody(), *bodyB->GetBulletRigidBody(), MakeTransform(pivotA, rotationA), MakeTransform(pivotB, rotationB));
+		}
+		
+		ConeTwistConstraint *ConeTwistConstraint::WithBodies(RigidBody *bodyA, const Vector3 &pivotA, const Quaternion &rotationA, RigidBody *bodyB, const Vector3 &pivotB, const Quaternion &rotationB)
+		{
+			ConeTwistConstraint *constraint = new ConeTwistConstraint(bodyA, pivotA, rotationA, bodyB, pivotB, rotationB);
+			return constraint->Autorelease();
+		}
+		
+		void ConeTwistConstraint::SetLimit(float swingSpan1, float swingSpan2, float twistSpan, float softness)
+		{
+			static_cast<btConeTwistConstraint *>(_constraint)->setLimit(swingSpan1, swingSpan2, twistSpan, softness);
+		}
+		void ConeTwistConstraint::SetDamping(float damping)
+		{
+			static_cast<btConeTwistConstraint *>(_constraint)->setDamping(damping);
+		}
+		
+		
+		SliderConstraint::SliderConstraint(RigidBody *bodyA, const Vector3 &pivotA, const Quaternion &rotationA, RigidBody *bodyB, const Vector3 &pivotB, const Quaternion &rotationB) :
+			Constraint(bodyA, bodyB)
+		{
+			_constraint = new btSliderConstraint(*bodyA->GetBulletRigidBody(), *bodyB->GetBulletRigidBody(), MakeTransform(pivotA, rotationA), MakeTransform(pivotB, rotationB), true);
+		}
+		
+		SliderConstraint *SliderConstraint::WithBodies(RigidBody *bodyA, const Vector3 &pivotA, const Quaternion &rotationA, RigidBody *bodyB, const Vector3 &pivotB, const Quaternion &rotationB)
+		{
+			SliderConstraint *constraint = new SliderConstraint(bodyA, pivotA, rotationA, bodyB, pivotB, rotationB);
+			return constraint->Autorelease();
+		}
+		
+		void SliderConstraint::SetLinearLimit(float lower, float upper)
+		{
+			btSliderConstraint *slider = static_cast<btSliderConstraint *>(_constraint);
+			slider->setLowerLinLimit(lower);
+			slider->setUpperLinLimit(upper);
+		}
+		void SliderConstraint::SetAngularLimit(float lower, float upper)
+		{
+			btSliderConstraint *slider = static_cast<btSliderConstraint *>(_constraint);
+			slider->setLowerAngLimit(lower);
+			slider->setUpperAngLimit(upper);
+		}
+		float SliderConstraint::GetLinearPosition()
+		{
+			return static_cast<btSliderConstraint *>(_constraint)->getLinearPos();
+		}
+		
+		
+		GenericSpringConstraint::GenericSpringConstraint(RigidBody *bodyA, const Vector3 &pivotA, const Quaternion &rotationA, RigidBody *bodyB, const Vector3 &pivotB, const Quaternion &rotationB) :
+			Constraint(bodyA, bodyB)
+		{
+			_constraint = new btGeneric6DofSpringConstraint(*bodyA->GetBulletRigidBody(), *bodyB->GetBulletRigidBody(), MakeTransform(pivotA, rotationA), MakeTransform(pivotB, rotationB), true);
+		}
+		
+		GenericSpringConstraint *GenericSpringConstraint::WithBodies(RigidBody *bodyA, const Vector3 &pivotA, const Quaternion &rotationA, RigidBody *bodyB, const Vector3 &pivotB, const Quaternion &rotationB)
+		{
+			GenericSpringConstraint *constraint = new GenericSpringConstraint(bodyA, pivotA, rotationA, bodyB, pivotB, rotationB);
+			return constraint->Autorelease();
+		}
+		
+		void GenericSpringConstraint::SetLinearLimit(const Vector3 &lower, const Vector3 &upper)
+		{
+			btGeneric6DofSpringConstraint *spring = static_cast<btGeneric6DofSpringConstraint *>(_constraint);
+			spring->setLinearLowerLimit(btVector3(lower.x, lower.y, lower.z));
+			spring->setLinearUpperLimit(btVector3(upper.x, upper.y, upper.z));
+		}
+		void GenericSpringConstraint::SetAngularLimit(const Vector3 &lower, const Vector3 &upper)
+		{
+			btGeneric6DofSpringConstraint *spring = static_cast<btGeneric6DofSpringConstraint *>(_constraint);
+			spring->setAngularLowerLimit(btVector3(lower.x, lower.y, lower.z));
+			spring->setAngularUpperLimit(btVector3(upper.x, upper.y, upper.z));
+		}
+		void GenericSpringConstraint::SetSpring(int index, bool enabled, float stiffness, float damping)
+		{
+			btGeneric6DofSpringConstraint *spring = static_cast<btGeneric6DofSpringConstraint *>(_constraint);
+			spring->enableSpring(index, enabled);
+			spring->setStiffness(index, stiffness);
+			spring->setDamping(index, damping);
+		}
+		void GenericSpringConstraint::SetEquilibriumPoint()
+		{
+			static_cast<btGeneric6DofSpringConstraint *>(_constraint)->setEquilibriumPoint();
+		}
+	}
+}
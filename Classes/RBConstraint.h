@@ -0,0 +1,158 @@
+//
+//  RBConstraint.h
+//  rayne-bullet
+//
+//  Copyright 2013 by Überpixel. All rights reserved.
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef __rayne_bullet__RBConstraint__
+#define __rayne_bullet__RBConstraint__
+
+#include <Rayne/Rayne.h>
+#include <btBulletDynamicsCommon.h>
+#include "RBRigidBody.h"
+
+namespace RN
+{
+	namespace bullet
+	{
+		class PhysicsWorld;
+		
+		class Constraint : public Object
+		{
+		public:
+			friend class PhysicsWorld;
+			
+			~Constraint() override;
+			
+			void SetEnabled(bool enabled);
+			void SetBreakingImpulseThreshold(float threshold);
+			void SetFeedbackEnabled(bool enabled);
+			void SetSolverIterations(int iterations);
+			void SetBreakCallback(std::function<void(Constraint *)> &&callback);
+			void SetDisableCollisionsBetweenBodies(bool disable);
+			
+			bool IsEnabled() const;
+			bool IsBroken() const { return _broken; }
+			bool IsBreakable() const;
+			float GetBreakingImpulseThreshold() const;
+			
+			// Returns 0 unless feedback is enabled, setting a breaking threshold turns it on
+			float GetAppliedImpulse() const;
+			int GetSolverIterations() const;
+			
+			RigidBody *GetBodyA() const { return _bodyA; }
+			RigidBody *GetBodyB() const { return _bodyB; }
+			PhysicsWorld *GetOwner() const { return _owner; }
+			
+			btTypedConstraint *GetBulletConstraint() { return _constraint; }
+			
+		protected:
+			Constraint(RigidBody *bodyA, RigidBody *bodyB);
+			
+			virtual void InsertIntoWorld(PhysicsWorld *world);
+			virtual void RemoveFromWorld(PhysicsWorld *world);
+			
+			static btTransform MakeTransform(const Vector3 &position, const Quaternion &rotation);
+			
+			btTypedConstraint *_constraint;
+			
+		private:
+			bool CheckBroken();
+			
+			RigidBody *_bodyA;
+			RigidBody *_bodyB;
+			PhysicsWorld *_owner;
+			
+			std::function<void(Constraint *)> _callback;
+			
+			bool _broken;
+			bool _userDisabled;
+			bool _disableCollisions;
+			
+			RNDeclareMeta(Constraint)
+		};
+		
+		class FixedConstraint : public Constraint
+		{
+		public:
+			FixedConstraint(RigidBody *bodyA, const Vector3 &pivotA, const Quaternion &rotationA, RigidBody *bodyB, const Vector3 &pivotB, const Quaternion &rotationB);
+			
+			static FixedConstraint *WithBodies(RigidBody *bodyA, const Vector3 &pivotA, const Quaternion &rotationA, RigidBody *bodyB, const Vector3 &pivotB, const Quaternion &rotationB);
+			
+			RNDeclareMeta(FixedConstraint)
+		};
+		
+		class HingeConstraint : public Constraint
+		{
+		public:
+			HingeConstraint(RigidBody *bodyA, const Vector3 &pivotA, const Quaternion &rotationA, RigidBody *bodyB, const Vector3 &pivotB, const Quaternion &rotationB);
+			
+			static HingeConstraint *WithBodies(RigidBody *bodyA, const Vector3 &pivotA, const Quaternion &rotationA, RigidBody *bodyB, const Vector3 &pivotB, const Quaternion &rotationB);
+			
+			void SetLimit(float low, float high, float softness = 0.9f);
+			void SetMotor(bool enabled, float targetVelocity, float maxImpulse);
+			
+			float GetHingeAngle();
+			
+			RNDeclareMeta(HingeConstraint)
+		};
+		
+		class ConeTwistConstraint : public Constraint
+		{
+		public:
+			ConeTwistConstraint(RigidBody *bodyA, const Vector3 &pivotA, const Quaternion &rotationA, RigidBody *bodyB, const Vector3 &pivotB, const Quaternion &rotationB);
+			
+			static ConeTwistConstraint *WithBodies(RigidBody *bodyA, const Vector3 &pivotA, const Quaternion &rotationA, RigidBody *bodyB, const Vector3 &pivotB, const Quaternion &rotationB);
+			
+			void SetLimit(float swingSpan1, float swingSpan2, float twistSpan, float softness = 1.0f);
+			void SetDamping(float damping);
+			
+			RNDeclareMeta(ConeTwistConstraint)
+		};
+		
+		class SliderConstraint : public Constraint
+		{
+		public:
+			SliderConstraint(RigidBody *bodyA, const Vector3 &pivotA, const Quaternion &rotationA, RigidBody *bodyB, const Vector3 &pivotB, const Quaternion &rotationB);
+			
+			static SliderConstraint *WithBodies(RigidBody *bodyA, const Vector3 &pivotA, const Quaternion &rotationA, RigidBody *bodyB, const Vector3 &pivotB, const Quaternion &rotationB);
+			
+			void SetLinearLimit(float lower, float upper);
+			void SetAngularLimit(float lower, float upper);
+			
+			float GetLinearPosition();
+			
+			RNDeclareMeta(SliderConstraint)
+		};
+		
+		class GenericSpringConstraint : public Constraint
+		{
+		public:
+			GenericSpringConstraint(RigidBody *bodyA, const Vector3 &pivotA, const Quaternion &rotationA, RigidBody *bodyB, const Vector3 &pivotB, const Quaternion &rotationB);
+			
+			static GenericSpringConstraint *WithBodies(RigidBody *bodyA, const Vector3 &pivotA, const Quaternion &rotationA, RigidBody *bodyB, const Vector3 &pivotB, const Quaternion &rotationB);
+			
+			void SetLinearLimit(const Vector3 &lower, const Vector3 &upper);
+			void SetAngularLimit(const Vector3 &lower, const Vector3 &upper);
+			
+			// Index 0-2 are the linear axes, 3-5 the angular axes
+			void SetSpring(int index, bool enabled, float stiffness, float damping);
+			void SetEquilibriumPoint();
+			
+			RNDeclareMeta(GenericSpringConstraint)
+		};
+	}
+}
+
+#endif /* defined(__rayne_bullet__RBConstraint__) */
@@ -0,0 +1,538 @@
+//
+//  RBCrowdController.cpp
+//  rayne-bullet
+//
+//  Copyright 2013 by Überpixel. All rights reserved.
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "RBCrowdController.h"
+#include "RBPhysicsWorld.h"
+
+#define kRBCrowdSlideIterations 4
+#define kRBCrowdMargin 0.01f
+
+namespace RN
+{
+	namespace bullet
+	{
+		RNDefineMeta(CrowdCharacter, CollisionObject)
+		
+		class CrowdSweepCallback : public btCollisionWorld::ClosestConvexResultCallback
+		{
+		public:
+			CrowdSweepCallback(const btVector3 &from, const btVector3 &to) :
+				btCollisionWorld::ClosestConvexResultCallback(from, to),
+				_direction(to - from)
+			{}
+			
+			btScalar addSingleResult(btCollisionWorld::LocalConvexResult &result, bool normalInWorldSpace) override
+			{
+				btVector3 normal = normalInWorldSpace ? result.m_hitNormalLocal : result.m_hitCollisionObject->getWorldTransform().getBasis() * result.m_hitNormalLocal;
+				
+				// Surfaces the character moves away from don't block it
+				if(normal.dot(_direction) > 0.0f)
+					return 1.0f;
+				
+				result.m_hitNormalLocal = normal;
+				return btCollisionWorld::ClosestConvexResultCallback::addSingleResult(result, true);
+			}
+			
+		private:
+			btVector3 _direction;
+		};
+		
+		template<class T>
+		static void CrowdRemoveAtIndex(std::vector<T> &vector, size_t index)
+		{
+			vector[index] = vector.back();
+			vector.pop_back();
+		}
+		
+		
+		CrowdCharacter::CrowdCharacter(Shape *shape, float stepHeight) :
+			_shape(shape->Retain()),
+			_crowd(nullptr),
+			_leaf(nullptr),
+			_index(0),
+			_synchronizing(false),
+			_stepHeight(stepHeight),
+			_fallSpeed(55.0f),
+			_jumpSpeed(5.0f),
+			_maxSlopeCosine(std::cos(btRadians(45.0f))),
+			_gravity(9.81f)
+		{
+			_object = new btCollisionObject();
+			_object->setCollisionShape(_shape->GetBulletShape());
+			_object->setCollisionFlags(_object->getCollisionFlags() | btCollisionObject::CF_KINEMATIC_OBJECT | btCollisionObject::CF_CHARACTER_OBJECT);
+			_object->setActivationState(DISABLE_DEACTIVATION);
+			_object->setUserPointer(this);
+		}
+		
+		CrowdCharacter::~CrowdCharacter()
+		{
+			delete _object;
+			_shape->Release();
+		}
+		
+		CrowdCharacter *CrowdCharacter::WithShape(Shape *shape, float stepHeight)
+		{
+			CrowdCharacter *character = new CrowdCharacter(shape, stepHeight);
+			return character->Autorelease();
+		}
+		
+		
+		void CrowdCharacter::SetWalkVelocity(const Vector3 &velocity)
+		{
+			_walkVelocity = velocity;
+			
+			if(_crowd)
+				_crowd->UpdateCharacter(this);
+		}
+		void CrowdCharacter::SetStepHeight(float height)
+		{
+			_stepHeight = height;
+			
+			if(_crowd)
+				_crowd->UpdateCharacter(this);
+		}
+		void CrowdCharacter::SetFallSpeed(float speed)
+		{
+			_fallSpeed = speed;
+			
+			if(_crowd)
+				_crowd->UpdateCharacter(this);
+		}
+		void CrowdCharacter::SetJumpSpeed(float speed)
+		{
+			_jumpSpeed = speed;
+		}
+		void CrowdCharacter::SetMaxSlope(float maxSlope)
+		{
+			_maxSlopeCosine = std::cos(maxSlope);
+			
+			if(_crowd)
+				_crowd->UpdateCharacter(this);
+		}
+		void CrowdCharacter::SetGravity(float gravity)
+		{
+			_gravity = gravity;
+			
+			if(_crowd)
+				_crowd->UpdateCharacter(this);
+		}
+		
+		void CrowdCharacter::Jump()
+		{
+			if(_crowd && _crowd->IsCharacterOnGround(this))
+				_crowd->JumpCharacter(this, _jumpSpeed);
+		}
+		
+		bool CrowdCharacter::IsOnGround() const
+		{
+			return (_crowd && _crowd->IsCharacterOnGround(this));
+		}
+		
+		
+		void CrowdCharacter::DidUpdate(SceneNode::ChangeSet changeSet)
+		{
+			CollisionObject::DidUpdate(changeSet);
+			
+			if((changeSet & SceneNode::ChangeSet::Position) && !_synchronizing)
+			{
+				Vector3 position = GetWorldPosition() - offset;
+				_object->getWorldTransform().setOrigin(btVector3(position.x, position.y, position.z));
+				
+				if(_crowd)
+					_crowd->WarpCharacter(this, position);
+			}
+		}
+		void CrowdCharacter::UpdateFromMaterial(PhysicsMaterial *material)
+		{}
+		
+		
+		void CrowdCharacter::InsertIntoWorld(PhysicsWorld *world)
+		{
+			CollisionObject::InsertIntoWorld(world);
+			
+			{
+				Vector3 position = GetWorldPosition() - offset;
+				_object->setWorldTransform(btTransform(btQuaternion::getIdentity(), btVector3(position.x, position.y, position.z)));
+			}
+			
+			auto bulletWorld = world->GetBulletDynamicsWorld();
+			bulletWorld->addCollisionObject(_object, GetCollisionFilter(), GetCollisionFilterMask());
+			
+			world->GetCrowdController()->AddCharacter(this);
+		}
+		
+		void CrowdCharacter::RemoveFromWorld(PhysicsWorld *world)
+		{
+			world->GetCrowdController()->RemoveCharacter(this);
+			
+			CollisionObject::RemoveFromWorld(world);
+			
+			auto bulletWorld = world->GetBulletDynamicsWorld();
+			bulletWorld->removeCollisionObject(_object);
+		}
+		
+		
+		
+		CrowdController::CrowdController(btDbvtBroadphase *broadphase) :
+			_broadphase(broadphase)
+		{}
+		
+		CrowdController::~CrowdController()
+		{
+			for(CrowdCharacter *character : _characters)
+			{
+				character->_crowd = nullptr;
+				character->_leaf = nullptr;
+			}
+		}
+		
+		void CrowdController::AddCharacter(CrowdCharacter *character)
+		{
+			const btVector3 &position = character->_object->getWorldTransform().getOrigin();
+			
+			btVector3 aabbMin, aabbMax;
+			character->_object->getCollisionShape()->getAabb(btTransform::getIdentity(), aabbMin, aabbMax);
+			
+			character->_crowd = this;
+			character->_index = _characters.size();
+			
+			_characters.push_back(character);
+			
+			_positionX.push_back(position.x());
+			_positionY.push_back(position.y());
+			_positionZ.push_back(position.z());
+			_extentX.push_back(std::max(-aabbMin.x(), aabbMax.x()));
+			_extentY.push_back(std::max(-aabbMin.y(), aabbMax.y()));
+			_extentZ.push_back(std::max(-aabbMin.z(), aabbMax.z()));
+			_walkX.push_back(0.0f);
+			_walkZ.push_back(0.0f);
+			_verticalVelocity.push_back(0.0f);
+			_stepHeight.push_back(0.0f);
+			_fallSpeed.push_back(0.0f);
+			_gravity.push_back(0.0f);
+			_maxSlopeCosine.push_back(0.0f);
+			_onGround.push_back(0);
+			
+			_bounds.push_back(btDbvtVolume::FromMM(position + aabbMin, position + aabbMax));
+			character->_leaf = _tree.insert(_bounds[_bounds.size() - 1], character);
+			
+			UpdateCharacter(character);
+		}
+		
+		void CrowdController::RemoveCharacter(CrowdCharacter *character)
+		{
+			if(character->_crowd != this)
+				return;
+			
+			size_t index = character->_index;
+			
+			CrowdRemoveAtIndex(_characters, index);
+			CrowdRemoveAtIndex(_positionX, index);
+			CrowdRemoveAtIndex(_positionY, index);
+			CrowdRemoveAtIndex(_positionZ, index);
+			CrowdRemoveAtIndex(_extentX, index);
+			CrowdRemoveAtIndex(_extentY, index);
+			CrowdRemoveAtIndex(_extentZ, index);
+			CrowdRemoveAtIndex(_walkX, index);
+			CrowdRemoveAtIndex(_walkZ, index);
+			CrowdRemoveAtIndex(_verticalVelocity, index);
+			CrowdRemoveAtIndex(_stepHeight, index);
+			CrowdRemoveAtIndex(_fallSpeed, index);
+			CrowdRemoveAtIndex(_gravity, index);
+			CrowdRemoveAtIndex(_maxSlopeCosine, index);
+			CrowdRemoveAtIndex(_onGround, index);
+			
+			_bounds.swap(static_cast<int>(index), _bounds.size() - 1);
+			_bounds.pop_back();
+			
+			if(index < _characters.size())
+				_characters[index]->_index = index;
+			
+			_tree.remove(character->_leaf);
+			
+			character->_leaf = nullptr;
+			character->_crowd = nullptr;
+		}
+		
+		void CrowdController::UpdateCharacter(CrowdCharacter *character)
+		{
+			size_t index = character->_index;
+			
+			_walkX[index] = character->_walkVelocity.x;
+			_walkZ[index] = character->_walkVelocity.z;
+			_stepHeight[index] = character->_stepHeight;
+			_fallSpeed[index] = character->_fallSpeed;
+			_gravity[index] = character->_gravity;
+			_maxSlopeCosine[index] = character->_maxSlopeCosine;
+		}
+		
+		void CrowdController::WarpCharacter(CrowdCharacter *character, const Vector3 &position)
+		{
+			size_t index = character->_index;
+			
+			_positionX[index] = position.x;
+			_positionY[index] = position.y;
+			_positionZ[index] = position.z;
+			_verticalVelocity[index] = 0.0f;
+			_onGround[index] = 0;
+		}
+		
+		void CrowdController::JumpCharacter(CrowdCharacter *character, float speed)
+		{
+			size_t index = character->_index;
+			
+			_verticalVelocity[index] = speed;
+			_onGround[index] = 0;
+		}
+		
+		void CrowdController::SynchronizeNodes()
+		{
+			size_t count = _characters.size();
+			
+			for(size_t i = 0; i < count; i ++)
+			{
+				CrowdCharacter *character = _characters[i];
+				if(!character->GetParent())
+					continue;
+				
+				character->_synchronizing = true;
+				character->SetWorldPosition(Vector3(_positionX[i], _positionY[i], _positionZ[i]) + character->offset);
+				character->_synchronizing = false;
+			}
+		}
+		
+		
+		void CrowdController::updateAction(btCollisionWorld *world, btScalar step)
+		{
+			if(_characters.empty())
+				return;
+			
+			UpdateBounds(step);
+			GatherCandidates();
+			MoveCharacters(step);
+		}
+		
+		void CrowdController::UpdateBounds(btScalar step)
+		{
+			size_t count = _characters.size();
+			
+			// Bounds of everything a character can reach this step, step up and snapping down included
+			for(size_t i = 0; i < count; i ++)
+			{
+				float moveX = _walkX[i] * step;
+				float moveZ = _walkZ[i] * step;
+				float vertical = _verticalVelocity[i] * step;
+				
+				float rise = _stepHeight[i] + std::max(vertical, 0.0f);
+				float drop = 2.0f * _stepHeight[i] + std::max(-vertical, 0.0f) + _gravity[i] * step * step;
+				
+				btVector3 minimum(_positionX[i] - _extentX[i] + std::min(moveX, 0.0f), _positionY[i] - _extentY[i] - drop, _positionZ[i] - _extentZ[i] + std::min(moveZ, 0.0f));
+				btVector3 maximum(_positionX[i] + _extentX[i] + std::max(moveX, 0.0f), _positionY[i] + _extentY[i] + rise, _positionZ[i] + _extentZ[i] + std::max(moveZ, 0.0f));
+				
+				_bounds[static_cast<int>(i)] = btDbvtVolume::FromMM(minimum, maximum);
+			}
+			
+			for(size_t i = 0; i < count; i ++)
+				_tree.update(_characters[i]->_leaf, _bounds[static_cast<int>(i)]);
+		}
+		
+		void CrowdController::GatherCandidates()
+		{
+			size_t count = _characters.size();
+			
+			_pairs.clear();
+			
+			// One traversal of the dynamic and the static broadphase tree for all characters
+			Collider collider(this);
+			_tree.collideTT(_tree.m_root, _broadphase->m_sets[0].m_root, collider);
+			_tree.collideTT(_tree.m_root, _broadphase->m_sets[1].m_root, collider);
+			
+			_candidateOffsets.assign(count + 1, 0);
+			_candidates.resize(_pairs.size());
+			
+			for(auto &pair : _pairs)
+				_candidateOffsets[pair.first + 1] ++;
+			
+			for(size_t i = 0; i < count; i ++)
+				_candidateOffsets[i + 1] += _candidateOffsets[i];
+			
+			std::vector<uint32> cursor(_candidateOffsets.begin(), _candidateOffsets.end() - 1);
+			
+			for(auto &pair : _pairs)
+				_candidates[cursor[pair.first] ++] = pair.second;
+		}
+		
+		bool CrowdController::Sweep(size_t index, const btVector3 &from, const btVector3 &to, btScalar &fraction, btVector3 &normal)
+		{
+			const btConvexShape *shape = static_cast<const btConvexShape *>(_characters[index]->_object->getCollisionShape());
+			
+			btTransform start(btQuaternion::getIdentity(), from);
+			btTransform end(btQuaternion::getIdentity(), to);
+			
+			CrowdSweepCallback callback(from, to);
+			
+			for(uint32 i = _candidateOffsets[index]; i < _candidateOffsets[index + 1]; i ++)
+			{
+				btCollisionObject *object = _candidates[i];
+				btCollisionWorld::objectQuerySingle(shape, start, end, object, object->getCollisionShape(), object->getWorldTransform(), callback, 0.0f);
+			}
+			
+			if(!callback.hasHit())
+				return false;
+			
+			fraction = callback.m_closestHitFraction;
+			normal = callback.m_hitNormalWorld.normalized();
+			
+			return true;
+		}
+		
+		void CrowdController::MoveCharacters(btScalar step)
+		{
+			size_t count = _characters.size();
+			const btVector3 up(0.0f, 1.0f, 0.0f);
+			
+			for(size_t i = 0; i < count; i ++)
+			{
+				btVector3 position(_positionX[i], _positionY[i], _positionZ[i]);
+				btScalar fraction;
+				btVector3 normal;
+				
+				float vertical = _verticalVelocity[i];
+				bool grounded = _onGround[i];
+				
+				// Step up, by the step height when walking and by the vertical velocity when jumping
+				float stepUp = (grounded && vertical <= 0.0f) ? _stepHeight[i] : 0.0f;
+				float rise = stepUp + std::max(vertical * step, 0.0f);
+				
+				if(rise > 0.0f)
+				{
+					btVector3 target = position + up * rise;
+					
+					if(Sweep(i, position, target, fraction, normal))
+					{
+						float climbed = std::max(rise * fraction - kRBCrowdMargin, 0.0f);
+						
+						position += up * climbed;
+						stepUp = std::min(stepUp, climbed);
+						vertical = std::min(vertical, 0.0f);
+					}
+					else
+					{
+						position = target;
+					}
+				}
+				
+				// Walk, sliding along everything that is hit
+				btVector3 move(_walkX[i] * step, 0.0f, _walkZ[i] * step);
+				
+				for(int iteration = 0; iteration < kRBCrowdSlideIterations && move.length2() > SIMD_EPSILON; iteration ++)
+				{
+					btVector3 target = position + move;
+					
+					if(!Sweep(i, position, target, fraction, normal))
+					{
+						position = target;
+						break;
+					}
+					
+					position.setInterpolate3(position, target, fraction);
+					position += normal * kRBCrowdMargin;
+					
+					btVector3 remaining = move * (1.0f - fraction);
+					move = remaining - normal * remaining.dot(normal);
+					
+					// Only walkable slopes may lift the character, walls only deflect it
+					if(normal.y() < _maxSlopeCosine[i])
+						move.setY(std::min(move.y(), btScalar(0.0f)));
+				}
+				
+				// Step down again, snapping to the ground while walking and falling otherwise
+				float fall = std::max(-vertical * step, 0.0f);
+				float snap = (grounded && vertical <= 0.0f) ? _stepHeight[i] : 0.0f;
+				float drop = stepUp + fall + snap;
+				
+				bool landed = false;
+				
+				if(drop > 0.0f)
+				{
+					btVector3 target = position - up * drop;
+					
+					if(Sweep(i, position, target, fraction, normal))
+					{
+						if(normal.y() >= _maxSlopeCosine[i])
+						{
+							position.setInterpolate3(position, target, fraction);
+							position += up * kRBCrowdMargin;
+							
+							landed = true;
+						}
+						else
+						{
+							position -= up * std::max(drop * fraction - kRBCrowdMargin, 0.0f);
+						}
+					}
+					else
+					{
+						position -= up * (stepUp + fall);
+					}
+				}
+				
+				if(landed)
+				{
+					vertical = 0.0f;
+				}
+				else
+				{
+					vertical = std::max(vertical - _gravity[i] * step, -_fallSpeed[i]);
+				}
+				
+				_positionX[i] = position.x();
+				_positionY[i] = position.y();
+				_positionZ[i] = position.z();
+				_verticalVelocity[i] = vertical;
+				_onGround[i] = landed;
+				
+				// Characters moved earlier in the pass are already seen at their new position by the later ones
+				_characters[i]->_object->getWorldTransform().setOrigin(position);
+			}
+		}
+		
+		
+		CrowdController::Collider::Collider(CrowdController *controller) :
+			controller(controller),
+			pairCache(static_cast<btHashedOverlappingPairCache *>(controller->_broadphase->getOverlappingPairCache()))
+		{}
+		
+		void CrowdController::Collider::Process(const btDbvtNode *characterLeaf, const btDbvtNode *proxyLeaf)
+		{
+			CrowdCharacter *character = static_cast<CrowdCharacter *>(characterLeaf->data);
+			
+			btBroadphaseProxy *proxy = static_cast<btBroadphaseProxy *>(proxyLeaf->data);
+			btBroadphaseProxy *characterProxy = character->_object->getBroadphaseHandle();
+			
+			btCollisionObject *object = static_cast<btCollisionObject *>(proxy->m_clientObject);
+			
+			if(object == character->_object || !object->hasContactResponse())
+				return;
+			
+			if(characterProxy && !pairCache->needsBroadphaseCollision(characterProxy, proxy))
+				return;
+			
+			controller->_pairs.emplace_back(static_cast<uint32>(character->_index), object);
+		}
+	}
+}
@@ -0,0 +1,147 @@
+//
+//  RBCrowdController.h
+//  rayne-bullet
+//
+//  Copyright 2013 by Überpixel. All rights reserved.
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef __rayne_bullet__RBCrowdController__
+#define __rayne_bullet__RBCrowdController__
+
+#include <Rayne/Rayne.h>
+#include <BulletCollision/BroadphaseCollision/btDbvtBroadphase.h>
+#include "RBCollisionObject.h"
+#include "RBShape.h"
+
+namespace RN
+{
+	namespace bullet
+	{
+		class CrowdController;
+		
+		class CrowdCharacter : public CollisionObject
+		{
+		public:
+			friend class CrowdController;
+			
+			CrowdCharacter(Shape *shape, float stepHeight);
+			~CrowdCharacter() override;
+			
+			static CrowdCharacter *WithShape(Shape *shape, float stepHeight);
+			
+			// Units per second, the vertical part is ignored
+			void SetWalkVelocity(const Vector3 &velocity);
+			void SetStepHeight(float height);
+			void SetFallSpeed(float speed);
+			void SetJumpSpeed(float speed);
+			void SetMaxSlope(float maxSlope);
+			void SetGravity(float gravity);
+			
+			void Jump();
+			bool IsOnGround() const;
+			
+			btCollisionObject *GetBulletCollisionObject() override { return _object; }
+			
+		protected:
+			void DidUpdate(SceneNode::ChangeSet changeSet) override;
+			void UpdateFromMaterial(PhysicsMaterial *material) override;
+			
+			void InsertIntoWorld(PhysicsWorld *world) override;
+			void RemoveFromWorld(PhysicsWorld *world) override;
+			
+		private:
+			Shape *_shape;
+			btCollisionObject *_object;
+			
+			CrowdController *_crowd;
+			btDbvtNode *_leaf;
+			size_t _index;
+			bool _synchronizing;
+			
+			Vector3 _walkVelocity;
+			float _stepHeight;
+			float _fallSpeed;
+			float _jumpSpeed;
+			float _maxSlopeCosine;
+			float _gravity;
+			
+			RNDeclareMeta(CrowdCharacter)
+		};
+		
+		// Steps all characters of a world as one action, with one shared broadphase pass and the hot state kept in flat arrays
+		class CrowdController : public btActionInterface
+		{
+		public:
+			CrowdController(btDbvtBroadphase *broadphase);
+			~CrowdController() override;
+			
+			void AddCharacter(CrowdCharacter *character);
+			void RemoveCharacter(CrowdCharacter *character);
+			void UpdateCharacter(CrowdCharacter *character);
+			void WarpCharacter(CrowdCharacter *character, const Vector3 &position);
+			void JumpCharacter(CrowdCharacter *character, float speed);
+			
+			bool IsCharacterOnGround(const CrowdCharacter *character) const { return _onGround[character->_index]; }
+			size_t GetCharacterCount() const { return _characters.size(); }
+			
+			// Writes the positions of all characters back to their nodes in one pass
+			void SynchronizeNodes();
+			
+			void updateAction(btCollisionWorld *world, btScalar step) override;
+			void debugDraw(btIDebugDraw *drawer) override {}
+			
+		private:
+			struct Collider : btDbvt::ICollide
+			{
+				Collider(CrowdController *controller);
+				void Process(const btDbvtNode *characterLeaf, const btDbvtNode *proxyLeaf);
+				
+				CrowdController *controller;
+				btHashedOverlappingPairCache *pairCache;
+			};
+			
+			void UpdateBounds(btScalar step);
+			void GatherCandidates();
+			void MoveCharacters(btScalar step);
+			bool Sweep(size_t index, const btVector3 &from, const btVector3 &to, btScalar &fraction, btVector3 &normal);
+			
+			btDbvtBroadphase *_broadphase;
+			btDbvt _tree;
+			
+			std::vector<CrowdCharacter *> _characters;
+			
+			std::vector<float> _positionX;
+			std::vector<float> _positionY;
+			std::vector<float> _positionZ;
+			std::vector<float> _extentX;
+			std::vector<float> _extentY;
+			std::vector<float> _extentZ;
+			std::vector<float> _walkX;
+			std::vector<float> _walkZ;
+			std::vector<float> _verticalVelocity;
+			std::vector<float> _stepHeight;
+			std::vector<float> _fallSpeed;
+			std::vector<float> _gravity;
+			std::vector<float> _maxSlopeCosine;
+			std::vector<uint8> _onGround;
+			
+			btAlignedObjectArray<btDbvtVolume> _bounds;
+			
+			std::vector<std::pair<uint32, btCollisionObject *>> _pairs;
+			std::vector<uint32> _candidateOffsets;
+			std::vector<btCollisionObject *> _candidates;
+		};
+	}
+}
+
+#endif /* defined(__rayne_bullet__RBCrowdController__) */
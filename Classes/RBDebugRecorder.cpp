@@ -0,0 +1,449 @@
+//
+//  RBDebugRecorder.cpp
+//  rayne-bullet
+//
+//  Copyright 2013 by Überpixel. All rights reserved.
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "RBDebugRecorder.h"
+#include "RBPhysicsWorld.h"
+
+#define kRBDebugRecorderMagic 0x44444252
+#define kRBDebugRecorderVersion 1
+#define kRBDebugRecorderMaxPendingFrames 8
+
+namespace RN
+{
+	namespace bullet
+	{
+		RNDefineMeta(DebugRecorder, Object)
+		
+		struct DebugRecorderFileHeader
+		{
+			uint32 magic;
+			uint32 version;
+			uint32 frame;
+			uint32 count;
+		};
+		
+		class DebugRecorderTriangleCallback : public btTriangleCallback
+		{
+		public:
+			DebugRecorderTriangleCallback(btIDebugDraw *recorder, const btTransform &transform, const btVector3 &color, const btVector3 &minimum, const btVector3 &maximum) :
+				_recorder(recorder),
+				_transform(transform),
+				_color(color),
+				_minimum(minimum),
+				_maximum(maximum)
+			{}
+			
+			void processTriangle(btVector3 *triangle, int partId, int triangleIndex) override
+			{
+				btVector3 vertices[3] = { _transform(triangle[0]), _transform(triangle[1]), _transform(triangle[2]) };
+				
+				// The local query box is conservative for rotated meshes, test again in world space
+				if(!TestTriangleAgainstAabb2(vertices, _minimum, _maximum))
+					return;
+				
+				_recorder->drawLine(vertices[0], vertices[1], _color);
+				_recorder->drawLine(vertices[1], vertices[2], _color);
+				_recorder->drawLine(vertices[2], vertices[0], _color);
+			}
+			
+		private:
+			btIDebugDraw *_recorder;
+			btTransform _transform;
+			btVector3 _color;
+			btVector3 _minimum;
+			btVector3 _maximum;
+		};
+		
+		static bool WriteHeader(FILE *file, uint32 frame, size_t count)
+		{
+			DebugRecorderFileHeader header;
+			header.magic = kRBDebugRecorderMagic;
+			header.version = kRBDebugRecorderVersion;
+			header.frame = frame;
+			header.count = static_cast<uint32>(count);
+			
+			return (fwrite(&header, sizeof(DebugRecorderFileHeader), 1, file) == 1);
+		}
+		
+		DebugRecorder::DebugRecorder(size_t capacity) :
+			_head(0),
+			_count(0),
+			_dropped(0),
+			_droppedFrames(0),
+			_frame(0),
+			_mode(DBG_DrawWireframe | DBG_DrawAabb | DBG_DrawContactPoints),
+			_layerMask(0xffffffff),
+			_layer(0),
+			_hasRegion(false),
+			_writerRunning(false)
+		{
+			_buffer.resize(std::max<size_t>(capacity, 1));
+		}
+		
+		DebugRecorder::~DebugRecorder()
+		{
+			{
+				std::lock_guard<std::mutex> lock(_writerLock);
+				_writerRunning = false;
+			}
+			
+			// The writer drains the queued frames before it exits
+			_writerSignal.notify_one();
+			
+			if(_writer.joinable())
+				_writer.join();
+		}
+		
+		
+		void DebugRecorder::SetRegion(const Vector3 &minimum, const Vector3 &maximum)
+		{
+			_regionMin = btVector3(minimum.x, minimum.y, minimum.z);
+			_regionMax = btVector3(maximum.x, maximum.y, maximum.z);
+			_hasRegion = true;
+		}
+		void DebugRecorder::ClearRegion()
+		{
+			_hasRegion = false;
+		}
+		void DebugRecorder::SetLayerMask(uint32 mask)
+		{
+			_layerMask = mask;
+		}
+		void DebugRecorder::SetOutputDirectory(const std::string &directory)
+		{
+			std::lock_guard<std::mutex> lock(_writerLock);
+			
+			_outputDirectory = directory;
+			
+			if(!_outputDirectory.empty() && !_writer.joinable())
+			{
+				// The frame buffers cycle between Capture() and the writer, each one fits a full ring buffer
+				_frameBuffers.resize(kRBDebugRecorderMaxPendingFrames);
+				_freeFrames.reserve(kRBDebugRecorderMaxPendingFrames);
+				_pendingFrames.reserve(kRBDebugRecorderMaxPendingFrames);
+				
+				for(PendingFrame &buffer : _frameBuffers)
+				{
+					buffer.primitives.reserve(_buffer.size());
+					_freeFrames.push_back(&buffer);
+				}
+				
+				_writerRunning = true;
+				_writer = std::thread(&DebugRecorder::RunWriter, this);
+			}
+		}
+		
+		bool DebugRecorder::IsInRegion(const btVector3 &minimum, const btVector3 &maximum) const
+		{
+			return (!_hasRegion || TestAabbAgainstAabb2(minimum, maximum, _regionMin, _regionMax));
+		}
+		
+		
+		void DebugRecorder::Push(PrimitiveType type, const btVector3 &from, const btVector3 &to, float value, const btVector3 &color)
+		{
+			if(_frames.empty())
+				return;
+			
+			// A full buffer overwrites the oldest retained primitive, which may belong to the current frame
+			if(_count == _buffer.size())
+			{
+				while(_frames.size() > 1 && _frames.front().count == 0)
+					_frames.pop_front();
+				
+				FrameRange &oldest = _frames.front();
+				
+				oldest.start = (oldest.start + 1) % _buffer.size();
+				oldest.count --;
+				
+				if(oldest.count == 0 && _frames.size() > 1)
+					_frames.pop_front();
+				
+				_count --;
+				_dropped ++;
+			}
+			
+			Primitive &primitive = _buffer[_head];
+			
+			primitive.from[0] = from.x();
+			primitive.from[1] = from.y();
+			primitive.from[2] = from.z();
+			primitive.to[0] = to.x();
+			primitive.to[1] = to.y();
+			primitive.to[2] = to.z();
+			primitive.value = value;
+			primitive.color = (static_cast<uint32>(btClamped(color.x(), btScalar(0.0f), btScalar(1.0f)) * 255.0f) << 24) |
+							  (static_cast<uint32>(btClamped(color.y(), btScalar(0.0f), btScalar(1.0f)) * 255.0f) << 16) |
+							  (static_cast<uint32>(btClamped(color.z(), btScalar(0.0f), btScalar(1.0f)) * 255.0f) << 8) | 0xff;
+			primitive.type = type;
+			primitive.layer = _layer;
+			primitive.reserved = 0;
+			
+			_head = (_head + 1) % _buffer.size();
+			_frames.back().count ++;
+			_count ++;
+		}
+		
+		void DebugRecorder::drawLine(const btVector3 &from, const btVector3 &to, const btVector3 &color)
+		{
+			Push(PrimitiveType::Line, from, to, 0.0f, color);
+		}
+		
+		void DebugRecorder::drawContactPoint(const btVector3 &point, const btVector3 &normal, btScalar distance, int lifeTime, const btVector3 &color)
+		{
+			Push(PrimitiveType::Contact, point, normal, distance, color);
+		}
+		
+		void DebugRecorder::DrawShape(btCollisionWorld *world, const btTransform &transform, const btCollisionShape *shape, const btVector3 &color)
+		{
+			if(!_hasRegion)
+			{
+				world->debugDrawObject(transform, shape, color);
+				return;
+			}
+			
+			if(shape->isCompound())
+			{
+				const btCompoundShape *compound = static_cast<const btCompoundShape *>(shape);
+				
+				for(int i = 0; i < compound->getNumChildShapes(); i ++)
+				{
+					btTransform childTransform = transform * compound->getChildTransform(i);
+					const btCollisionShape *child = compound->getChildShape(i);
+					
+					btVector3 minimum, maximum;
+					child->getAabb(childTransform, minimum, maximum);
+					
+					if(IsInRegion(minimum, maximum))
+						DrawShape(world, childTransform, child, color);
+				}
+				
+				return;
+			}
+			
+			if(shape->isConcave())
+			{
+				// Only the triangles inside the region are recorded, not the whole mesh
+				btVector3 minimum, maximum;
+				btTransformAabb(_regionMin, _regionMax, 0.0f, transform.inverse(), minimum, maximum);
+				
+				DebugRecorderTriangleCallback callback(this, transform, color, _regionMin, _regionMax);
+				static_cast<const btConcaveShape *>(shape)->processAllTriangles(&callback, minimum, maximum);
+				
+				return;
+			}
+			
+			world->debugDrawObject(transform, shape, color);
+		}
+		
+		
+		void DebugRecorder::Capture(PhysicsWorld *world)
+		{
+			btCollisionWorld *bulletWorld = world->GetBulletDynamicsWorld();
+			
+			_frame ++;
+			
+			while(!_frames.empty() && _frames.front().count == 0)
+				_frames.pop_front();
+			
+			_frames.push_back({ _frame, _head, 0 });
+			
+			btCollisionObjectArray &objects = bulletWorld->getCollisionObjectArray();
+			
+			for(int i = 0; i < objects.size(); i ++)
+			{
+				btCollisionObject *object = objects[i];
+				
+				btVector3 minimum, maximum;
+				object->getCollisionShape()->getAabb(object->getWorldTransform(), minimum, maximum);
+				
+				if(!IsInRegion(minimum, maximum))
+					continue;
+				
+				CollisionObject *owner = static_cast<CollisionObject *>(object->getUserPointer());
+				uint32 layer = owner ? owner->GetCollisionLayer() : 0;
+				
+				if(!(_layerMask & (1u << layer)))
+					continue;
+				
+				_layer = static_cast<uint8>(layer);
+				
+				if(_mode & DBG_DrawWireframe)
+				{
+					btVector3 color = object->isActive() ? btVector3(1.0f, 1.0f, 1.0f) : btVector3(0.0f, 1.0f, 0.0f);
+					DrawShape(bulletWorld, object->getWorldTransform(), object->getCollisionShape(), color);
+				}
+				
+				if(_mode & DBG_DrawAabb)
+					Push(PrimitiveType::AABB, minimum, maximum, 0.0f, btVector3(1.0f, 0.0f, 0.0f));
+			}
+			
+			if(_mode & DBG_DrawContactPoints)
+			{
+				btDispatcher *dispatcher = bulletWorld->getDispatcher();
+				
+				for(int i = 0; i < dispatcher->getNumManifolds(); i ++)
+				{
+					btPersistentManifold *manifold = dispatcher->getManifoldByIndexInternal(i);
+					
+					CollisionObject *owner0 = static_cast<CollisionObject *>(manifold->getBody0()->getUserPointer());
+					CollisionObject *owner1 = static_cast<CollisionObject *>(manifold->getBody1()->getUserPointer());
+					
+					uint32 layer0 = owner0 ? owner0->GetCollisionLayer() : 0;
+					uint32 layer1 = owner1 ? owner1->GetCollisionLayer() : 0;
+					
+					if(!(_layerMask & ((1u << layer0) | (1u << layer1))))
+						continue;
+					
+					_layer = static_cast<uint8>(layer0);
+					
+					for(int j = 0; j < manifold->getNumContacts(); j ++)
+					{
+						const btManifoldPoint &point = manifold->getContactPoint(j);
+						
+						if(!IsInRegion(point.getPositionWorldOnB(), point.getPositionWorldOnB()))
+							continue;
+						
+						Push(PrimitiveType::Contact, point.getPositionWorldOnB(), point.m_normalWorldOnB, point.getDistance(), btVector3(1.0f, 1.0f, 0.0f));
+					}
+				}
+			}
+			
+			// Capture runs inside the step, so it only copies the frame into a free buffer and leaves the file to the writer thread
+			PendingFrame *pending;
+			
+			{
+				std::lock_guard<std::mutex> lock(_writerLock);
+				
+				if(_outputDirectory.empty())
+					return;
+				
+				if(_freeFrames.empty())
+				{
+					_droppedFrames ++;
+					return;
+				}
+				
+				pending = _freeFrames.back();
+				_freeFrames.pop_back();
+			}
+			
+			const FrameRange &range = _frames.back();
+			
+			size_t first = std::min(range.count, _buffer.size() - range.start);
+			
+			pending->frame = _frame;
+			pending->primitives.clear();
+			pending->primitives.insert(pending->primitives.end(), _buffer.begin() + range.start, _buffer.begin() + (range.start + first));
+			pending->primitives.insert(pending->primitives.end(), _buffer.begin(), _buffer.begin() + (range.count - first));
+			
+			{
+				std::lock_guard<std::mutex> lock(_writerLock);
+				_pendingFrames.push_back(pending);
+			}
+			
+			_writerSignal.notify_one();
+		}
+		
+		void DebugRecorder::RunWriter()
+		{
+			std::unique_lock<std::mutex> lock(_writerLock);
+			
+			while(1)
+			{
+				_writerSignal.wait(lock, [this] { return (!_writerRunning || !_pendingFrames.empty()); });
+				
+				if(_pendingFrames.empty())
+					break;
+				
+				PendingFrame *pending = _pendingFrames.front();
+				_pendingFrames.erase(_pendingFrames.begin());
+				
+				char name[32];
+				snprintf(name, sizeof(name), "/frame_%08u.rbdd", pending->frame);
+				
+				// Frames queued before the output was switched off are dropped
+				std::string path = _outputDirectory.empty() ? std::string() : _outputDirectory + name;
+				
+				lock.unlock();
+				
+				FILE *file = path.empty() ? nullptr : fopen(path.c_str(), "wb");
+				if(file)
+				{
+					if(WriteHeader(file, pending->frame, pending->primitives.size()) && !pending->primitives.empty())
+						fwrite(pending->primitives.data(), sizeof(Primitive), pending->primitives.size(), file);
+					
+					fclose(file);
+				}
+				
+				lock.lock();
+				_freeFrames.push_back(pending);
+			}
+		}
+		
+		bool DebugRecorder::WriteRange(FILE *file, const FrameRange &range) const
+		{
+			if(!WriteHeader(file, range.frame, range.count))
+				return false;
+			
+			// The frame may wrap around the end of the ring buffer
+			size_t first = std::min(range.count, _buffer.size() - range.start);
+			size_t second = range.count - first;
+			
+			if(first > 0 && fwrite(&_buffer[range.start], sizeof(Primitive), first, file) != first)
+				return false;
+			
+			if(second > 0 && fwrite(&_buffer[0], sizeof(Primitive), second, file) != second)
+				return false;
+			
+			return true;
+		}
+		
+		bool DebugRecorder::WriteFrame(const std::string &path) const
+		{
+			if(_frames.empty())
+				return false;
+			
+			FILE *file = fopen(path.c_str(), "wb");
+			if(!file)
+				return false;
+			
+			bool result = WriteRange(file, _frames.back());
+			
+			fclose(file);
+			return result;
+		}
+		
+		bool DebugRecorder::WriteFrames(const std::string &path) const
+		{
+			FILE *file = fopen(path.c_str(), "wb");
+			if(!file)
+				return false;
+			
+			// Retained frames follow each other, oldest first, each with its own header
+			bool result = true;
+			
+			for(const FrameRange &range : _frames)
+			{
+				if(!(result = WriteRange(file, range)))
+					break;
+			}
+			
+			fclose(file);
+			return result;
+		}
+	}
+}
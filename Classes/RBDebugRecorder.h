@@ -0,0 +1,135 @@
+//
+//  RBDebugRecorder.h
+//  rayne-bullet
+//
+//  Copyright 2013 by Überpixel. All rights reserved.
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef __rayne_bullet__RBDebugRecorder__
+#define __rayne_bullet__RBDebugRecorder__
+
+#include <Rayne/Rayne.h>
+#include <btBulletDynamicsCommon.h>
+#include <deque>
+#include <thread>
+#include <condition_variable>
+
+namespace RN
+{
+	namespace bullet
+	{
+		class PhysicsWorld;
+		
+		// Captures debug geometry into a preallocated ring buffer without a renderer, for offline replay.
+		// The buffer keeps as many of the latest frames as fit, a frame that doesn't fit loses its oldest primitives
+		class DebugRecorder : public Object, public btIDebugDraw
+		{
+		public:
+			enum class PrimitiveType : uint8
+			{
+				Line,
+				Contact,
+				AABB
+			};
+			
+			// Contacts store their normal in to and their distance in value
+			struct Primitive
+			{
+				float from[3];
+				float to[3];
+				float value;
+				uint32 color;
+				PrimitiveType type;
+				uint8 layer;
+				uint16 reserved;
+			};
+			
+			DebugRecorder(size_t capacity);
+			~DebugRecorder() override;
+			
+			void SetRegion(const Vector3 &minimum, const Vector3 &maximum);
+			void ClearRegion();
+			void SetLayerMask(uint32 mask);
+			
+			// Every captured frame is written to a file in the directory when set, on a writer thread
+			void SetOutputDirectory(const std::string &directory);
+			
+			void Capture(PhysicsWorld *world);
+			bool WriteFrame(const std::string &path) const;
+			bool WriteFrames(const std::string &path) const;
+			
+			uint32 GetFrame() const { return _frame; }
+			size_t GetRetainedFrameCount() const { return _frames.size(); }
+			size_t GetFramePrimitiveCount() const { return _frames.empty() ? 0 : _frames.back().count; }
+			size_t GetDroppedCount() const { return _dropped; }
+			size_t GetDroppedFrameCount() const { return _droppedFrames; }
+			
+			void drawLine(const btVector3 &from, const btVector3 &to, const btVector3 &color) override;
+			void drawContactPoint(const btVector3 &point, const btVector3 &normal, btScalar distance, int lifeTime, const btVector3 &color) override;
+			void reportErrorWarning(const char *warning) override {}
+			void draw3dText(const btVector3 &location, const char *text) override {}
+			void setDebugMode(int mode) override { _mode = mode; }
+			int getDebugMode() const override { return _mode; }
+			
+		private:
+			struct FrameRange
+			{
+				uint32 frame;
+				size_t start;
+				size_t count;
+			};
+			
+			struct PendingFrame
+			{
+				uint32 frame;
+				std::vector<Primitive> primitives;
+			};
+			
+			void Push(PrimitiveType type, const btVector3 &from, const btVector3 &to, float value, const btVector3 &color);
+			bool IsInRegion(const btVector3 &minimum, const btVector3 &maximum) const;
+			void DrawShape(btCollisionWorld *world, const btTransform &transform, const btCollisionShape *shape, const btVector3 &color);
+			bool WriteRange(FILE *file, const FrameRange &range) const;
+			void RunWriter();
+			
+			std::vector<Primitive> _buffer;
+			std::deque<FrameRange> _frames;
+			size_t _head;
+			size_t _count;
+			size_t _dropped;
+			size_t _droppedFrames;
+			uint32 _frame;
+			
+			int _mode;
+			uint32 _layerMask;
+			uint8 _layer;
+			
+			bool _hasRegion;
+			btVector3 _regionMin;
+			btVector3 _regionMax;
+			
+			std::string _outputDirectory;
+			
+			std::thread _writer;
+			std::mutex _writerLock;
+			std::condition_variable _writerSignal;
+			std::vector<PendingFrame> _frameBuffers;
+			std::vector<PendingFrame *> _freeFrames;
+			std::vector<PendingFrame *> _pendingFrames;
+			bool _writerRunning;
+			
+			RNDeclareMeta(DebugRecorder)
+		};
+	}
+}
+
+#endif /* defined(__rayne_bullet__RBDebugRecorder__) */
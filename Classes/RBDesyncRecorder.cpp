@@ -0,0 +1,189 @@
+//
+//  RBDesyncRecorder.cpp
+//  rayne-bullet
+//
+//  Copyright 2013 by Überpixel. All rights reserved.
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "RBDesyncRecorder.h"
+
+#define kRBDesyncRecorderMagic 0x53444252
+#define kRBDesyncRecorderVersion 1
+
+namespace RN
+{
+	namespace bullet
+	{
+		RNDefineMeta(DesyncRecorder, Object)
+		
+		struct DesyncRecorderFileHeader
+		{
+			uint32 magic;
+			uint32 version;
+			uint32 count;
+		};
+		
+		struct DesyncRecorderStepHeader
+		{
+			uint32 step;
+			uint32 inputSize;
+			uint32 bodyCount;
+			uint64 checksum;
+		};
+		
+		DesyncRecorder::DesyncRecorder(size_t history) :
+			_history(std::max<size_t>(history, 1))
+		{}
+		
+		DesyncRecorder *DesyncRecorder::WithHistory(size_t history)
+		{
+			DesyncRecorder *recorder = new DesyncRecorder(history);
+			return recorder->Autorelease();
+		}
+		
+		DesyncRecorder *DesyncRecorder::WithLog(const std::string &path)
+		{
+			FILE *file = fopen(path.c_str(), "rb");
+			if(!file)
+				return nullptr;
+			
+			DesyncRecorderFileHeader header;
+			
+			if(fread(&header, sizeof(DesyncRecorderFileHeader), 1, file) != 1 || header.magic != kRBDesyncRecorderMagic || header.version != kRBDesyncRecorderVersion)
+			{
+				fclose(file);
+				return nullptr;
+			}
+			
+			DesyncRecorder *recorder = new DesyncRecorder(header.count);
+			
+			for(uint32 i = 0; i < header.count; i ++)
+			{
+				DesyncRecorderStepHeader stepHeader;
+				
+				if(fread(&stepHeader, sizeof(DesyncRecorderStepHeader), 1, file) != 1)
+					break;
+				
+				Step step;
+				step.step = stepHeader.step;
+				step.checksum = stepHeader.checksum;
+				step.input.resize(stepHeader.inputSize);
+				step.bodies.resize(stepHeader.bodyCount);
+				
+				if(fread(step.input.data(), 1, step.input.size(), file) != step.input.size() ||
+				   fread(step.bodies.data(), sizeof(uint32), step.bodies.size(), file) != step.bodies.size())
+					break;
+				
+				recorder->_steps.push_back(std::move(step));
+			}
+			
+			fclose(file);
+			return recorder->Autorelease();
+		}
+		
+		
+		void DesyncRecorder::RecordInput(const void *data, size_t size)
+		{
+			const uint8 *bytes = static_cast<const uint8 *>(data);
+			_pendingInput.insert(_pendingInput.end(), bytes, bytes + size);
+		}
+		
+		void DesyncRecorder::RecordStep(uint32 step, uint64 checksum, const std::vector<uint32> &bodies)
+		{
+			if(_steps.size() == _history)
+				_steps.pop_front();
+			
+			Step record;
+			record.step = step;
+			record.checksum = checksum;
+			record.input = std::move(_pendingInput);
+			record.bodies = bodies;
+			
+			_steps.push_back(std::move(record));
+			_pendingInput.clear();
+		}
+		
+		const DesyncRecorder::Step *DesyncRecorder::GetStep(uint32 step) const
+		{
+			if(_steps.empty() || step < _steps.front().step || step > _steps.back().step)
+				return nullptr;
+			
+			// Steps are recorded consecutively, so the offset is the index
+			const Step &record = _steps[step - _steps.front().step];
+			return (record.step == step) ? &record : nullptr;
+		}
+		
+		bool DesyncRecorder::FindDivergence(const DesyncRecorder *other, uint32 &step, size_t &body) const
+		{
+			for(const Step &record : _steps)
+			{
+				const Step *otherRecord = other->GetStep(record.step);
+				
+				if(!otherRecord || otherRecord->checksum == record.checksum)
+					continue;
+				
+				step = record.step;
+				
+				// A differing body count points at the first body only one side has
+				size_t count = std::min(record.bodies.size(), otherRecord->bodies.size());
+				body = count;
+				
+				for(size_t i = 0; i < count; i ++)
+				{
+					if(record.bodies[i] != otherRecord->bodies[i])
+					{
+						body = i;
+						break;
+					}
+				}
+				
+				return true;
+			}
+			
+			return false;
+		}
+		
+		bool DesyncRecorder::WriteLog(const std::string &path) const
+		{
+			FILE *file = fopen(path.c_str(), "wb");
+			if(!file)
+				return false;
+			
+			DesyncRecorderFileHeader header;
+			header.magic = kRBDesyncRecorderMagic;
+			header.version = kRBDesyncRecorderVersion;
+			header.count = static_cast<uint32>(_steps.size());
+			
+			bool result = (fwrite(&header, sizeof(DesyncRecorderFileHeader), 1, file) == 1);
+			
+			for(const Step &record : _steps)
+			{
+				if(!result)
+					break;
+				
+				DesyncRecorderStepHeader stepHeader;
+				stepHeader.step = record.step;
+				stepHeader.inputSize = static_cast<uint32>(record.input.size());
+				stepHeader.bodyCount = static_cast<uint32>(record.bodies.size());
+				stepHeader.checksum = record.checksum;
+				
+				result = (fwrite(&stepHeader, sizeof(DesyncRecorderStepHeader), 1, file) == 1 &&
+						  fwrite(record.input.data(), 1, record.input.size(), file) == record.input.size() &&
+						  fwrite(record.bodies.data(), sizeof(uint32), record.bodies.size(), file) == record.bodies.size());
+			}
+			
+			fclose(file);
+			return result;
+		}
+	}
+}
@@ -0,0 +1,67 @@
+//
+//  RBDesyncRecorder.h
+//  rayne-bullet
+//
+//  Copyright 2013 by Überpixel. All rights reserved.
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef __rayne_bullet__RBDesyncRecorder__
+#define __rayne_bullet__RBDesyncRecorder__
+
+#include <Rayne/Rayne.h>
+#include <deque>
+
+namespace RN
+{
+	namespace bullet
+	{
+		// Logs the checksums of the last steps next to the inputs applied before them, to bisect lockstep desyncs
+		class DesyncRecorder : public Object
+		{
+		public:
+			struct Step
+			{
+				uint32 step;
+				uint64 checksum;
+				std::vector<uint8> input;
+				std::vector<uint32> bodies;
+			};
+			
+			DesyncRecorder(size_t history);
+			
+			static DesyncRecorder *WithHistory(size_t history);
+			static DesyncRecorder *WithLog(const std::string &path);
+			
+			// Input that is applied before the next simulation step, can be called multiple times per step
+			void RecordInput(const void *data, size_t size);
+			void RecordStep(uint32 step, uint64 checksum, const std::vector<uint32> &bodies);
+			
+			// Finds the first step both logs hold with different checksums and the index of the first body that differs in it
+			bool FindDivergence(const DesyncRecorder *other, uint32 &step, size_t &body) const;
+			
+			const Step *GetStep(uint32 step) const;
+			const std::deque<Step> &GetSteps() const { return _steps; }
+			
+			bool WriteLog(const std::string &path) const;
+			
+		private:
+			size_t _history;
+			std::deque<Step> _steps;
+			std::vector<uint8> _pendingInput;
+			
+			RNDeclareMeta(DesyncRecorder)
+		};
+	}
+}
+
+#endif /* defined(__rayne_bullet__RBDesyncRecorder__) */
@@ -110,10 +110,7 @@ namespace RN
 			}
 		}
 		void KinematicController::UpdateFromMaterial(PhysicsMaterial *material)
-		{
-			_ghost->setFriction(material->GetFriction());
-			_ghost->setRestitution(material->GetRestitution());
-		}
+		{}
 		
 		
 		void KinematicController::InsertIntoWorld(PhysicsWorld *world)
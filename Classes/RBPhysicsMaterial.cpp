@@ -30,6 +30,9 @@ namespace RN
 			
 			_friction    = 0.8f;
 			_restitution = 0.1f;
+			
+			_frictionCombineMode    = CombineMode::Multiply;
+			_restitutionCombineMode = CombineMode::Multiply;
 		}
 		
 		
@@ -57,5 +60,36 @@ namespace RN
 			_restitution = restitution;
 			signal.Emit(this);
 		}
+		
+		void PhysicsMaterial::SetFrictionCombineMode(CombineMode mode)
+		{
+			_frictionCombineMode = mode;
+			signal.Emit(this);
+		}
+		
+		void PhysicsMaterial::SetRestitutionCombineMode(CombineMode mode)
+		{
+			_restitutionCombineMode = mode;
+			signal.Emit(this);
+		}
+		
+		
+		
+		float PhysicsMaterial::Combine(CombineMode mode, float value1, float value2)
+		{
+			switch(mode)
+			{
+				case CombineMode::Average:
+					return (value1 + value2) * 0.5f;
+				case CombineMode::Minimum:
+					return std::min(value1, value2);
+				case CombineMode::Multiply:
+					return value1 * value2;
+				case CombineMode::Maximum:
+					return std::max(value1, value2);
+			}
+			
+			return value1 * value2;
+		}
 	}
 }
@@ -27,17 +27,32 @@ namespace RN
 		class PhysicsMaterial : public Object
 		{
 		public:
+			// Two materials in contact use the mode that comes last in this list
+			enum class CombineMode : uint8
+			{
+				Average,
+				Minimum,
+				Multiply,
+				Maximum
+			};
+			
 			PhysicsMaterial();
 			
 			void SetLinearDamping(float damping);
 			void SetAngularDamping(float damping);
 			void SetFriction(float friction);
 			void SetRestitution(float restitution);
+			void SetFrictionCombineMode(CombineMode mode);
+			void SetRestitutionCombineMode(CombineMode mode);
 			
 			float GetLinearDamping() const { return _linearDamping; }
 			float GetAngularDamping() const { return _angularDamping; }
 			float GetFriction() const { return _friction; }
 			float GetRestitution() const { return _restitution; }
+			CombineMode GetFrictionCombineMode() const { return _frictionCombineMode; }
+			CombineMode GetRestitutionCombineMode() const { return _restitutionCombineMode; }
+			
+			static float Combine(CombineMode mode, float value1, float value2);
 			
 			Signal<void (PhysicsMaterial *)> signal;
 			
@@ -48,6 +63,9 @@ namespace RN
 			float _friction;
 			float _restitution;
 			
+			CombineMode _frictionCombineMode;
+			CombineMode _restitutionCombineMode;
+			
 			RNDeclareMeta(PhysicsMaterial)
 		};
 	}
@@ -16,7 +16,26 @@
 //
 
 #include <BulletCollision/CollisionDispatch/btGhostObject.h>
+#include <BulletCollision/Gimpact/btGImpactCollisionAlgorithm.h>
+#include <BulletCollision/CollisionShapes/btMultimaterialTriangleMeshShape.h>
+#include <BulletDynamics/Featherstone/btMultiBodyConstraintSolver.h>
+#include <BulletDynamics/Featherstone/btMultiBodyLinkCollider.h>
+#include <BulletDynamics/MLCPSolvers/btMLCPSolver.h>
+#include <BulletDynamics/MLCPSolvers/btDantzigSolver.h>
+#include <BulletDynamics/MLCPSolvers/btSolveProjectedGaussSeidel.h>
 #include "RBPhysicsWorld.h"
+#include "RBAllocator.h"
+#include "RBVehicle.h"
+#include "RBCrowdController.h"
+#include "RBTriggerVolume.h"
+#include "RBDebugRecorder.h"
+#include "RBWorldPartition.h"
+#include "RBDesyncRecorder.h"
+
+#if defined(__SSE4_1__) || defined(__AVX__)
+#include <smmintrin.h>
+#define RB_CHECKSUM_SSE 1
+#endif
 
 namespace RN
 {
@@ -25,35 +44,127 @@ namespace RN
 		RNDefineMeta(PhysicsWorld, WorldAttachment)
 		RNDefineSingleton(PhysicsWorld)
 		
-		PhysicsWorld::PhysicsWorld(const Vector3 &gravity)
-		:_maxSteps(10), _stepSize(1.0/60.0)
+		static std::mutex _worldBindingLock;
+		static std::unordered_map<World *, PhysicsWorld *> _worldBindings;
+		
+		class LayerFilterCallback : public btOverlapFilterCallback
+		{
+		public:
+			LayerFilterCallback(const uint32 *matrix) :
+				_matrix(matrix)
+			{}
+			
+			bool needBroadphaseCollision(btBroadphaseProxy *proxy0, btBroadphaseProxy *proxy1) const override
+			{
+				CollisionObject *object0 = static_cast<CollisionObject *>(static_cast<btCollisionObject *>(proxy0->m_clientObject)->getUserPointer());
+				CollisionObject *object1 = static_cast<CollisionObject *>(static_cast<btCollisionObject *>(proxy1->m_clientObject)->getUserPointer());
+				
+				uint32 filter = ((proxy0->m_collisionFilterGroup & proxy1->m_collisionFilterMask) != 0) & ((proxy1->m_collisionFilterGroup & proxy0->m_collisionFilterMask) != 0);
+				uint32 layers = (_matrix[object0->GetCollisionLayer()] >> object1->GetCollisionLayer()) & 1;
+				
+				return (filter & layers);
+			}
+			
+		private:
+			const uint32 *_matrix;
+		};
+		
+		PhysicsWorld::PhysicsWorld(const Vector3 &gravity, bool articulated, Solver solver)
+		:_mlcpSolver(nullptr), _vehicleBatch(nullptr), _crowdController(nullptr), _debugRecorder(nullptr), _worldPartition(nullptr), _desyncRecorder(nullptr), _world(nullptr), _arena(Allocator::CreateArena()), _stepSize(1.0/60.0), _maxSteps(10), _articulated(articulated), _deferredBroadphase(false), _solver(Solver::SequentialImpulse), _hasChangedMaterials(false), _memoryBudget(0), _memoryBudgetInterval(60), _memoryBudgetCounter(0), _memoryBudgetExceeded(false), _checksumEnabled(false), _checksum(0), _checksumStep(0)
 		{
-			MakeShared();
+			// Additional worlds stay private, the first one becomes the fallback for unbound scenes
+			if(!GetSharedInstance())
+				MakeShared();
+			
+			AllocatorScope scope(_arena);
+			
+			std::fill(_layerMatrix, _layerMatrix + MaxLayers, 0xffffffff);
 			
 			_pairCallback = new btGhostPairCallback();
+			_layerFilterCallback = new LayerFilterCallback(_layerMatrix);
 			
 			_broadphase = new btDbvtBroadphase();
 			_broadphase->getOverlappingPairCache()->setInternalGhostPairCallback(_pairCallback);
+			_broadphase->getOverlappingPairCache()->setOverlapFilterCallback(_layerFilterCallback);
 			
 			_collisionConfiguration = new btDefaultCollisionConfiguration();
 			_dispatcher = new btCollisionDispatcher(_collisionConfiguration);
+			_dispatcher->setNearCallback(&PhysicsWorld::NearCallback);
 			
-			_constraintSolver = new btSequentialImpulseConstraintSolver();
+			gContactAddedCallback = &PhysicsWorld::ContactAddedCallback;
+			
+			btGImpactCollisionAlgorithm::registerAlgorithm(_dispatcher);
+			
+			if(_articulated)
+			{
+				btMultiBodyConstraintSolver *solver = new btMultiBodyConstraintSolver();
+				
+				_constraintSolver = solver;
+				_dynamicsWorld = new btMultiBodyDynamicsWorld(_dispatcher, _broadphase, solver, _collisionConfiguration);
+			}
+			else
+			{
+				_constraintSolver = CreateConstraintSolver(solver);
+				_dynamicsWorld = new btDiscreteDynamicsWorld(_dispatcher, _broadphase, _constraintSolver, _collisionConfiguration);
+				
+				if(_mlcpSolver)
+					_dynamicsWorld->getSolverInfo().m_minimumSolverBatchSize = 1;
+			}
 			
-			_dynamicsWorld = new btDiscreteDynamicsWorld(_dispatcher, _broadphase, _constraintSolver, _collisionConfiguration);
 			_dynamicsWorld->setGravity(btVector3(gravity.x, gravity.y, gravity.z));
 			
-			_dynamicsWorld->setInternalTickCallback(&PhysicsWorld::SimulationStepTickCallback);
+			_dynamicsWorld->setInternalTickCallback(&PhysicsWorld::SimulationStepTickCallback, this);
 		}
 		
 		PhysicsWorld::~PhysicsWorld()
 		{
-			delete _dynamicsWorld;
-			delete _constraintSolver;
-			delete _dispatcher;
-			delete _collisionConfiguration;
-			delete _broadphase;
-			delete _pairCallback;
+			BindToWorld(nullptr);
+			SafeRelease(_debugRecorder);
+			SafeRelease(_desyncRecorder);
+			
+			for(size_t i = 0; i < _materials.size(); i ++)
+			{
+				if(!_materials[i])
+					continue;
+				
+				_materialConnections[i]->Disconnect();
+				_materials[i]->Release();
+			}
+			
+			{
+				AllocatorScope scope(_arena);
+				
+				for(Constraint *constraint : _constraints)
+				{
+					constraint->RemoveFromWorld(this);
+					constraint->Release();
+				}
+				
+				if(_vehicleBatch)
+				{
+					_dynamicsWorld->removeAction(_vehicleBatch);
+					delete _vehicleBatch;
+				}
+				
+				if(_crowdController)
+				{
+					_dynamicsWorld->removeAction(_crowdController);
+					delete _crowdController;
+				}
+				
+				delete _dynamicsWorld;
+				delete _constraintSolver;
+				delete _mlcpSolver;
+				delete _dispatcher;
+				delete _collisionConfiguration;
+				delete _broadphase;
+				delete _pairCallback;
+				delete _layerFilterCallback;
+			}
+			
+			// Everything the world allocated goes away with its arena
+			if(_arena)
+				_arena->Destroy();
 		}
 		
 		void PhysicsWorld::SimulationStepTickCallback(btDynamicsWorld *world, btScalar timeStep)
@@ -71,6 +182,333 @@ namespace RN
 				if(objectB->_callback)
 					objectB->_callback(objectA);
 			}
+			
+			PhysicsWorld *physicsWorld = static_cast<PhysicsWorld *>(world->getWorldUserInfo());
+			if(physicsWorld->_checksumEnabled)
+				physicsWorld->UpdateChecksum();
+		}
+		
+		static const uint32 ChecksumPrime = 0x01000193;
+		static const uint32 ChecksumSeeds[4] = { 0x811c9dc5, 0x2545f491, 0x9e3779b9, 0x85ebca6b };
+		
+		// Four independent FNV lanes over 16 byte blocks, the SSE path yields the same value as the scalar one
+		static void HashBlocks(const uint32 *words, size_t blocks, uint32 *lanes)
+		{
+#if RB_CHECKSUM_SSE
+			__m128i hash = _mm_loadu_si128(reinterpret_cast<const __m128i *>(lanes));
+			const __m128i prime = _mm_set1_epi32(ChecksumPrime);
+			
+			for(size_t i = 0; i < blocks; i ++)
+			{
+				__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(words + i * 4));
+				hash = _mm_mullo_epi32(_mm_xor_si128(hash, block), prime);
+			}
+			
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), hash);
+#else
+			for(size_t i = 0; i < blocks; i ++)
+			{
+				for(size_t j = 0; j < 4; j ++)
+					lanes[j] = (lanes[j] ^ words[i * 4 + j]) * ChecksumPrime;
+			}
+#endif
+		}
+		
+		static uint32 FinalizeLane(uint32 hash)
+		{
+			hash ^= hash >> 16;
+			hash *= 0x85ebca6b;
+			hash ^= hash >> 13;
+			hash *= 0xc2b2ae35;
+			hash ^= hash >> 16;
+			
+			return hash;
+		}
+		
+		void PhysicsWorld::UpdateChecksum()
+		{
+			btCollisionObjectArray &objects = _dynamicsWorld->getCollisionObjectArray();
+			
+			_checksumSnapshot.clear();
+			_checksumSnapshot.reserve(objects.size());
+			
+			for(int i = 0; i < objects.size(); i ++)
+			{
+				btRigidBody *body = btRigidBody::upcast(objects[i]);
+				if(!body)
+					continue;
+				
+				const btTransform &transform = body->getWorldTransform();
+				const btMatrix3x3 &basis = transform.getBasis();
+				
+				BodyState state;
+				
+				for(int j = 0; j < 3; j ++)
+				{
+					state.position[j] = transform.getOrigin()[j];
+					state.linearVelocity[j] = body->getLinearVelocity()[j];
+					state.angularVelocity[j] = body->getAngularVelocity()[j];
+					
+					for(int k = 0; k < 3; k ++)
+						state.basis[j * 3 + k] = basis[j][k];
+				}
+				
+				state.activation = static_cast<uint32>(body->getActivationState());
+				state.padding = 0;
+				
+				_checksumSnapshot.push_back(state);
+			}
+			
+			const uint32 *words = reinterpret_cast<const uint32 *>(_checksumSnapshot.data());
+			const size_t blocksPerBody = sizeof(BodyState) / 16;
+			
+			uint32 lanes[4] = { ChecksumSeeds[0], ChecksumSeeds[1], ChecksumSeeds[2], ChecksumSeeds[3] };
+			HashBlocks(words, _checksumSnapshot.size() * blocksPerBody, lanes);
+			
+			_checksum = (static_cast<uint64>(FinalizeLane(lanes[0] ^ lanes[2])) << 32) | FinalizeLane(lanes[1] ^ lanes[3]);
+			_checksumStep ++;
+			
+			if(!_desyncRecorder)
+				return;
+			
+			_bodyChecksums.resize(_checksumSnapshot.size());
+			
+			for(size_t i = 0; i < _checksumSnapshot.size(); i ++)
+			{
+				uint32 bodyLanes[4] = { ChecksumSeeds[0], ChecksumSeeds[1], ChecksumSeeds[2], ChecksumSeeds[3] };
+				HashBlocks(words + i * blocksPerBody * 4, blocksPerBody, bodyLanes);
+				
+				_bodyChecksums[i] = FinalizeLane(bodyLanes[0] ^ bodyLanes[1] ^ bodyLanes[2] ^ bodyLanes[3]);
+			}
+			
+			_desyncRecorder->RecordStep(_checksumStep, _checksum, _bodyChecksums);
+		}
+		
+		void PhysicsWorld::SetChecksumEnabled(bool enabled)
+		{
+			LockGuard<PhysicsWorld *> lock(this);
+			_checksumEnabled = (enabled || _desyncRecorder);
+		}
+		
+		void PhysicsWorld::SetDesyncRecorder(DesyncRecorder *recorder)
+		{
+			LockGuard<PhysicsWorld *> lock(this);
+			
+			SafeRelease(_desyncRecorder);
+			_desyncRecorder = SafeRetain(recorder);
+			
+			if(_desyncRecorder)
+				_checksumEnabled = true;
+		}
+		
+		void PhysicsWorld::NearCallback(btBroadphasePair &pair, btCollisionDispatcher &dispatcher, const btDispatcherInfo &info)
+		{
+			const btCollisionObject *object0 = static_cast<btCollisionObject *>(pair.m_pProxy0->m_clientObject);
+			const btCollisionObject *object1 = static_cast<btCollisionObject *>(pair.m_pProxy1->m_clientObject);
+			
+			// Triggers run their own narrowphase, or none at all
+			if(TriggerVolume::IsTrigger(object0) || TriggerVolume::IsTrigger(object1))
+				return;
+			
+			btCollisionDispatcher::defaultNearCallback(pair, dispatcher, info);
+		}
+		
+		static const btMaterial *GetTriangleMaterial(const btCollisionShape *shape, int part, int index)
+		{
+			// Scaled instances share the mesh, and with it the material table, of their child
+			if(shape->getShapeType() == SCALED_TRIANGLE_MESH_SHAPE_PROXYTYPE)
+				shape = static_cast<const btScaledBvhTriangleMeshShape *>(shape)->getChildShape();
+			
+			if(shape->getShapeType() != MULTIMATERIAL_TRIANGLE_MESH_PROXYTYPE)
+				return nullptr;
+			
+			btMultimaterialTriangleMeshShape *materialShape = static_cast<btMultimaterialTriangleMeshShape *>(const_cast<btCollisionShape *>(shape));
+			return materialShape->getMaterialProperties(part, index);
+		}
+		
+		bool PhysicsWorld::ContactAddedCallback(btManifoldPoint &point, const btCollisionObjectWrapper *wrapper0, int part0, int index0, const btCollisionObjectWrapper *wrapper1, int part1, int index1)
+		{
+			const btCollisionObject *object0 = wrapper0->getCollisionObject();
+			const btCollisionObject *object1 = wrapper1->getCollisionObject();
+			
+			CollisionObject *owner0 = static_cast<CollisionObject *>(object0->getUserPointer());
+			CollisionObject *owner1 = static_cast<CollisionObject *>(object1->getUserPointer());
+			
+			const btMaterial *triangle0 = GetTriangleMaterial(object0->getCollisionShape(), part0, index0);
+			const btMaterial *triangle1 = GetTriangleMaterial(object1->getCollisionShape(), part1, index1);
+			
+			uint32 material0 = owner0 ? owner0->_materialIndex : NoMaterial;
+			uint32 material1 = owner1 ? owner1->_materialIndex : NoMaterial;
+			
+			if(!triangle0 && !triangle1 && material0 != NoMaterial && material1 != NoMaterial)
+			{
+				PhysicsWorld *world = owner0->_owner;
+				const MaterialPair &pair = world->_materialPairs[material0 * world->_materials.size() + material1];
+				
+				point.m_combinedFriction = pair.friction;
+				point.m_combinedRestitution = pair.restitution;
+				
+				return true;
+			}
+			
+			// Objects without a material keep their own values and Bullet's multiply
+			float friction0 = object0->getFriction();
+			float friction1 = object1->getFriction();
+			float restitution0 = object0->getRestitution();
+			float restitution1 = object1->getRestitution();
+			
+			PhysicsMaterial::CombineMode frictionMode = PhysicsMaterial::CombineMode::Multiply;
+			PhysicsMaterial::CombineMode restitutionMode = PhysicsMaterial::CombineMode::Multiply;
+			
+			if(material0 != NoMaterial)
+			{
+				PhysicsMaterial *material = owner0->_material;
+				
+				friction0 = material->GetFriction();
+				restitution0 = material->GetRestitution();
+				frictionMode = material->GetFrictionCombineMode();
+				restitutionMode = material->GetRestitutionCombineMode();
+			}
+			
+			if(material1 != NoMaterial)
+			{
+				PhysicsMaterial *material = owner1->_material;
+				
+				friction1 = material->GetFriction();
+				restitution1 = material->GetRestitution();
+				frictionMode = (material0 != NoMaterial) ? std::max(frictionMode, material->GetFrictionCombineMode()) : material->GetFrictionCombineMode();
+				restitutionMode = (material0 != NoMaterial) ? std::max(restitutionMode, material->GetRestitutionCombineMode()) : material->GetRestitutionCombineMode();
+			}
+			
+			// Triangle meshes with materials replace their own values with the ones of the touched triangle
+			if(triangle0)
+			{
+				friction0 = triangle0->m_friction;
+				restitution0 = triangle0->m_restitution;
+			}
+			
+			if(triangle1)
+			{
+				friction1 = triangle1->m_friction;
+				restitution1 = triangle1->m_restitution;
+			}
+			
+			point.m_combinedFriction = btClamped(PhysicsMaterial::Combine(frictionMode, friction0, friction1), -10.0f, 10.0f);
+			point.m_combinedRestitution = PhysicsMaterial::Combine(restitutionMode, restitution0, restitution1);
+			
+			return true;
+		}
+		
+		
+		uint32 PhysicsWorld::RegisterMaterial(PhysicsMaterial *material)
+		{
+			LockGuard<PhysicsWorld *> lock(this);
+			
+			auto iterator = _materialIndices.find(material);
+			if(iterator != _materialIndices.end())
+			{
+				_materialUseCounts[iterator->second] ++;
+				return iterator->second;
+			}
+			
+			uint32 index;
+			
+			if(!_freeMaterialSlots.empty())
+			{
+				index = _freeMaterialSlots.back();
+				_freeMaterialSlots.pop_back();
+			}
+			else
+			{
+				index = static_cast<uint32>(_materials.size());
+				size_t count = _materials.size() + 1;
+				
+				// Grow the table by one row and column, the existing pairs keep their values
+				std::vector<MaterialPair> pairs(count * count);
+				
+				for(size_t i = 0; i < index; i ++)
+					std::copy(_materialPairs.begin() + i * index, _materialPairs.begin() + (i + 1) * index, pairs.begin() + i * count);
+				
+				_materialPairs = std::move(pairs);
+				_materials.push_back(nullptr);
+				_materialConnections.push_back(nullptr);
+				_materialUseCounts.push_back(0);
+				_materialsChanged.push_back(false);
+			}
+			
+			_materials[index] = material->Retain();
+			_materialConnections[index] = material->signal.Connect(std::bind(&PhysicsWorld::MaterialDidChange, this, index));
+			_materialUseCounts[index] = 1;
+			_materialsChanged[index] = false;
+			_materialIndices.emplace(material, index);
+			
+			UpdateMaterialPairs(index);
+			return index;
+		}
+		
+		void PhysicsWorld::UnregisterMaterial(uint32 index)
+		{
+			LockGuard<PhysicsWorld *> lock(this);
+			
+			if(-- _materialUseCounts[index] > 0)
+				return;
+			
+			// The slot is reused by the next new material, which rewrites its row and column
+			_materialConnections[index]->Disconnect();
+			_materialIndices.erase(_materials[index]);
+			_materials[index]->Release();
+			
+			_materials[index] = nullptr;
+			_materialConnections[index] = nullptr;
+			_freeMaterialSlots.push_back(index);
+		}
+		
+		void PhysicsWorld::MaterialDidChange(uint32 index)
+		{
+			LockGuard<PhysicsWorld *> lock(this);
+			
+			UpdateMaterialPairs(index);
+			
+			// Friction and restitution are resolved per contact, damping is pushed to the bodies once before the next step
+			_materialsChanged[index] = true;
+			_hasChangedMaterials = true;
+		}
+		
+		void PhysicsWorld::UpdateMaterialDamping()
+		{
+			for(CollisionObject *object : _collisionObjects)
+			{
+				if(object->_materialIndex != NoMaterial && _materialsChanged[object->_materialIndex])
+					object->UpdateFromMaterial(object->_material);
+			}
+			
+			std::fill(_materialsChanged.begin(), _materialsChanged.end(), false);
+			_hasChangedMaterials = false;
+		}
+		
+		void PhysicsWorld::UpdateMaterialPairs(uint32 index)
+		{
+			LockGuard<PhysicsWorld *> lock(this);
+			
+			PhysicsMaterial *material = _materials[index];
+			size_t count = _materials.size();
+			
+			for(size_t i = 0; i < count; i ++)
+			{
+				PhysicsMaterial *other = _materials[i];
+				if(!other)
+					continue;
+				
+				PhysicsMaterial::CombineMode frictionMode = std::max(material->GetFrictionCombineMode(), other->GetFrictionCombineMode());
+				PhysicsMaterial::CombineMode restitutionMode = std::max(material->GetRestitutionCombineMode(), other->GetRestitutionCombineMode());
+				
+				MaterialPair pair;
+				pair.friction = btClamped(PhysicsMaterial::Combine(frictionMode, material->GetFriction(), other->GetFriction()), -10.0f, 10.0f);
+				pair.restitution = PhysicsMaterial::Combine(restitutionMode, material->GetRestitution(), other->GetRestitution());
+				
+				_materialPairs[index * count + i] = pair;
+				_materialPairs[i * count + index] = pair;
+			}
 		}
 		
 		void PhysicsWorld::SetGravity(const Vector3 &gravity)
@@ -79,25 +517,469 @@ namespace RN
 			_dynamicsWorld->setGravity(btVector3(gravity.x, gravity.y, gravity.z));
 		}
 		
+		void PhysicsWorld::BindToWorld(World *world)
+		{
+			std::lock_guard<std::mutex> lock(_worldBindingLock);
+			
+			if(_world)
+			{
+				auto iterator = _worldBindings.find(_world);
+				if(iterator != _worldBindings.end() && iterator->second == this)
+					_worldBindings.erase(iterator);
+			}
+			
+			_world = world;
+			
+			if(_world)
+				_worldBindings[_world] = this;
+		}
+		
+		PhysicsWorld *PhysicsWorld::GetPhysicsWorld(World *world)
+		{
+			{
+				std::lock_guard<std::mutex> lock(_worldBindingLock);
+				
+				auto iterator = _worldBindings.find(world);
+				if(iterator != _worldBindings.end())
+					return iterator->second;
+			}
+			
+			return GetSharedInstance();
+		}
+		
+		void PhysicsWorld::StepWorlds(const std::vector<PhysicsWorld *> &worlds, float delta)
+		{
+#if defined(BT_NO_PROFILE)
+			bool serial = (worlds.size() <= 1);
+#else
+			// Bullet's profiler is global and not thread safe, stepping in parallel needs BT_NO_PROFILE
+			bool serial = true;
+#endif
+			
+			if(serial)
+			{
+				for(PhysicsWorld *world : worlds)
+					world->StepWorld(delta);
+				
+				return;
+			}
+			
+			ThreadPool::Batch *batch = ThreadPool::GetSharedInstance()->CreateBatch();
+			
+			for(PhysicsWorld *world : worlds)
+			{
+				batch->AddTask([world, delta] {
+					world->StepWorld(delta);
+				});
+			}
+			
+			batch->Commit();
+			batch->Wait();
+			batch->Release();
+		}
+		
+		VehicleBatch *PhysicsWorld::GetVehicleBatch()
+		{
+			LockGuard<PhysicsWorld *> lock(this);
+			
+			if(!_vehicleBatch)
+			{
+				_vehicleBatch = new VehicleBatch(static_cast<btDbvtBroadphase *>(_broadphase));
+				_dynamicsWorld->addAction(_vehicleBatch);
+			}
+			
+			return _vehicleBatch;
+		}
+		
+		void PhysicsWorld::SetDebugRecorder(DebugRecorder *recorder)
+		{
+			LockGuard<PhysicsWorld *> lock(this);
+			
+			SafeRelease(_debugRecorder);
+			_debugRecorder = SafeRetain(recorder);
+			
+			_dynamicsWorld->setDebugDrawer(_debugRecorder);
+		}
+		
+		void PhysicsWorld::SetWorldPartition(WorldPartition *partition)
+		{
+			LockGuard<PhysicsWorld *> lock(this);
+			
+			_worldPartition = partition;
+		}
+		
+		CrowdController *PhysicsWorld::GetCrowdController()
+		{
+			LockGuard<PhysicsWorld *> lock(this);
+			
+			if(!_crowdController)
+			{
+				_crowdController = new CrowdController(static_cast<btDbvtBroadphase *>(_broadphase));
+				_dynamicsWorld->addAction(_crowdController);
+			}
+			
+			return _crowdController;
+		}
+		
 		void PhysicsWorld::SetStepSize(double stepsize, int maxsteps)
 		{
 			_stepSize = stepsize;
 			_maxSteps = maxsteps;
 		}
 		
+		
+		btConstraintSolver *PhysicsWorld::CreateConstraintSolver(Solver solver)
+		{
+			btMLCPSolverInterface *mlcpSolver = nullptr;
+			
+			switch(solver)
+			{
+				case Solver::SequentialImpulse:
+					break;
+				case Solver::MLCPDantzig:
+					mlcpSolver = new btDantzigSolver();
+					break;
+				case Solver::MLCPProjectedGaussSeidel:
+					mlcpSolver = new btSolveProjectedGaussSeidel();
+					break;
+			}
+			
+			delete _mlcpSolver;
+			
+			_mlcpSolver = mlcpSolver;
+			_solver = solver;
+			
+			if(_mlcpSolver)
+				return new btMLCPSolver(_mlcpSolver);
+			
+			return new btSequentialImpulseConstraintSolver();
+		}
+		
+		void PhysicsWorld::SetSolver(Solver solver)
+		{
+			LockGuard<PhysicsWorld *> lock(this);
+			
+			// Articulated worlds always use the multi body solver
+			if(_articulated || solver == _solver)
+				return;
+			
+			btConstraintSolver *oldSolver = _constraintSolver;
+			btMLCPSolverInterface *oldMLCPSolver = _mlcpSolver;
+			
+			_mlcpSolver = nullptr;
+			_constraintSolver = CreateConstraintSolver(solver);
+			
+			_dynamicsWorld->setConstraintSolver(_constraintSolver);
+			
+			// Direct solvers work best on small islands, the iterative solver prefers big batches
+			_dynamicsWorld->getSolverInfo().m_minimumSolverBatchSize = _mlcpSolver ? 1 : 128;
+			
+			delete oldSolver;
+			delete oldMLCPSolver;
+		}
+		
+		void PhysicsWorld::SetSolverIterations(int iterations)
+		{
+			LockGuard<PhysicsWorld *> lock(this);
+			_dynamicsWorld->getSolverInfo().m_numIterations = iterations;
+		}
+		
+		void PhysicsWorld::SetSolverSOR(float sor)
+		{
+			LockGuard<PhysicsWorld *> lock(this);
+			_dynamicsWorld->getSolverInfo().m_sor = sor;
+		}
+		
+		void PhysicsWorld::SetWarmStarting(bool enabled, float factor)
+		{
+			LockGuard<PhysicsWorld *> lock(this);
+			btContactSolverInfo &info = _dynamicsWorld->getSolverInfo();
+			
+			if(enabled)
+				info.m_solverMode |= SOLVER_USE_WARMSTARTING;
+			else
+				info.m_solverMode &= ~SOLVER_USE_WARMSTARTING;
+			
+			info.m_warmstartingFactor = factor;
+		}
+		
+		void PhysicsWorld::SetSplitImpulse(bool enabled, float penetrationThreshold)
+		{
+			LockGuard<PhysicsWorld *> lock(this);
+			btContactSolverInfo &info = _dynamicsWorld->getSolverInfo();
+			
+			info.m_splitImpulse = enabled;
+			info.m_splitImpulsePenetrationThreshold = penetrationThreshold;
+		}
+		
+		AllocatorArena::Statistics PhysicsWorld::GetAllocatorStatistics() const
+		{
+			if(!_arena)
+				return AllocatorArena::Statistics();
+			
+			return _arena->GetStatistics();
+		}
+		
+		PhysicsWorld::MemoryStats PhysicsWorld::GetMemoryStats()
+		{
+			LockGuard<PhysicsWorld *> lock(this);
+			
+			MemoryStats stats = {};
+			
+			btCollisionObjectArray &objects = _dynamicsWorld->getCollisionObjectArray();
+			std::unordered_set<const btCollisionShape *> shapes;
+			std::vector<const btCollisionShape *> pending;
+			
+			for(int i = 0; i < objects.size(); i ++)
+			{
+				const btCollisionObject *object = objects[i];
+				
+				switch(object->getInternalType())
+				{
+					case btCollisionObject::CO_RIGID_BODY:
+						stats.objects += sizeof(btRigidBody) + static_cast<const btRigidBody *>(object)->getNumConstraintRefs() * sizeof(btTypedConstraint *);
+						break;
+					case btCollisionObject::CO_GHOST_OBJECT:
+						stats.objects += sizeof(btPairCachingGhostObject) + static_cast<const btGhostObject *>(object)->getNumOverlappingObjects() * sizeof(btCollisionObject *);
+						break;
+					case btCollisionObject::CO_FEATHERSTONE_LINK:
+						stats.objects += sizeof(btMultiBodyLinkCollider);
+						break;
+					default:
+						stats.objects += sizeof(btCollisionObject);
+						break;
+				}
+				
+				pending.push_back(object->getCollisionShape());
+			}
+			
+			// Shared shapes are counted once, children of compounds and instances on their own
+			while(!pending.empty())
+			{
+				const btCollisionShape *shape = pending.back();
+				pending.pop_back();
+				
+				if(!shape || !shapes.insert(shape).second)
+					continue;
+				
+				stats.shapes += Shape::GetBulletMemoryFootprint(shape);
+				
+				if(shape->getShapeType() == COMPOUND_SHAPE_PROXYTYPE)
+				{
+					const btCompoundShape *compound = static_cast<const btCompoundShape *>(shape);
+					
+					for(int i = 0; i < compound->getNumChildShapes(); i ++)
+						pending.push_back(compound->getChildShape(i));
+				}
+				else if(shape->getShapeType() == SCALED_TRIANGLE_MESH_SHAPE_PROXYTYPE)
+				{
+					pending.push_back(static_cast<const btScaledBvhTriangleMeshShape *>(shape)->getChildShape());
+				}
+			}
+			
+			stats.shapeCount = shapes.size();
+			
+			for(int i = 0; i < _dynamicsWorld->getNumConstraints(); i ++)
+				stats.constraints += _dynamicsWorld->getConstraint(i)->calculateSerializeBufferSize();
+			
+			btDbvtBroadphase *broadphase = static_cast<btDbvtBroadphase *>(_broadphase);
+			
+			for(int i = 0; i < 2; i ++)
+				stats.broadphase += std::max(broadphase->m_sets[i].m_leaves * 2 - 1, 0) * sizeof(btDbvtNode);
+			
+			stats.broadphase += objects.size() * sizeof(btDbvtProxy);
+			
+			// The hashed cache keeps a hash table and a next index per pair slot
+			btBroadphasePairArray &pairs = broadphase->m_paircache->getOverlappingPairArray();
+			stats.pairCache = pairs.capacity() * (sizeof(btBroadphasePair) + 2 * sizeof(int));
+			
+			stats.manifolds = _dispatcher->getNumManifolds() * (sizeof(btPersistentManifold) + sizeof(btPersistentManifold *));
+			stats.arenaReserved = _arena ? _arena->GetStatistics().bytesReserved : 0;
+			
+			stats.total = stats.shapes + stats.objects + stats.constraints + stats.broadphase + stats.pairCache + stats.manifolds;
+			
+			return stats;
+		}
+		
+		void PhysicsWorld::SetMemoryBudget(size_t budget, std::function<void (PhysicsWorld *, const MemoryStats &)> &&callback, uint32 interval)
+		{
+			LockGuard<PhysicsWorld *> lock(this);
+			
+			_memoryBudget = budget;
+			_memoryBudgetCallback = std::move(callback);
+			_memoryBudgetInterval = std::max<uint32>(interval, 1);
+			_memoryBudgetCounter = 0;
+			_memoryBudgetExceeded = false;
+		}
+		
+		void PhysicsWorld::UpdateMemoryBudget()
+		{
+			if(_memoryBudget == 0 || !_memoryBudgetCallback)
+				return;
+			
+			if(++ _memoryBudgetCounter < _memoryBudgetInterval)
+				return;
+			
+			_memoryBudgetCounter = 0;
+			
+			MemoryStats stats = GetMemoryStats();
+			bool exceeded = (stats.total > _memoryBudget);
+			
+			if(exceeded && !_memoryBudgetExceeded)
+				_memoryBudgetCallback(this, stats);
+			
+			_memoryBudgetExceeded = exceeded;
+		}
+		
+		int PhysicsWorld::GetSolverIterations() const
+		{
+			return _dynamicsWorld->getSolverInfo().m_numIterations;
+		}
+		
 		void PhysicsWorld::StepWorld(float delta)
 		{
-			_dynamicsWorld->stepSimulation(delta, _maxSteps, _stepSize);
+			Lock();
+			
+			if(_arena)
+				_arena->ResetStepCounters();
+			
+			if(_hasChangedMaterials)
+				UpdateMaterialDamping();
+			
+			int steps;
+			
+			{
+				AllocatorScope scope(_arena);
+				steps = _dynamicsWorld->stepSimulation(delta, _maxSteps, _stepSize);
+			}
+			
+			// The first substep after a bulk insertion or layer change found the new pairs with one tree against tree pass,
+			// a call that only interpolated didn't run the broadphase and keeps the pass pending
+			if(_deferredBroadphase && steps > 0)
+			{
+				static_cast<btDbvtBroadphase *>(_broadphase)->m_deferedcollide = false;
+				_deferredBroadphase = false;
+			}
+			
+			if(_crowdController)
+				_crowdController->SynchronizeNodes();
+			
+			UpdateSleepEvents();
+			
+			if(_debugRecorder)
+				_debugRecorder->Capture(this);
+			
+			Unlock();
+			
+			UpdateBrokenConstraints();
+			UpdateTriggers();
+			UpdateMemoryBudget();
 		}
 		
+		void PhysicsWorld::UpdateSleepEvents()
+		{
+			_sleepEvents.clear();
+			
+			btCollisionObjectArray &objects = _dynamicsWorld->getCollisionObjectArray();
+			
+			for(int i = 0; i < objects.size(); i ++)
+			{
+				btCollisionObject *bulletObject = objects[i];
+				
+				// Kinematic bodies are deactivated by Bullet through the regular thresholds and report like dynamic ones
+				if(bulletObject->isStaticObject())
+					continue;
+				
+				// Compound objects such as articulations own several Bullet objects, only their main one reports
+				CollisionObject *object = static_cast<CollisionObject *>(bulletObject->getUserPointer());
+				if(!object || object->GetBulletCollisionObject() != bulletObject)
+					continue;
+				
+				bool sleeping = !bulletObject->isActive();
+				if(sleeping != object->_sleeping)
+				{
+					object->_sleeping = sleeping;
+					_sleepEvents.push_back({ object, sleeping });
+				}
+			}
+		}
+		
+		void PhysicsWorld::UpdateTriggers()
+		{
+			Lock();
+			
+			for(TriggerVolume *trigger : _triggers)
+			{
+				trigger->UpdateOverlaps(_dynamicsWorld);
+				
+				if(trigger->HasEvents())
+					_firingTriggers.push_back(trigger->Retain());
+			}
+			
+			Unlock();
+			
+			for(TriggerVolume *trigger : _firingTriggers)
+			{
+				trigger->FireEvents();
+				trigger->Release();
+			}
+			
+			_firingTriggers.clear();
+		}
+		
+		void PhysicsWorld::UpdateBrokenConstraints()
+		{
+			Lock();
+			
+			for(Constraint *constraint : _constraints)
+			{
+				if(constraint->CheckBroken())
+					_brokenConstraints.push_back(constraint->Retain());
+			}
+			
+			Unlock();
+			
+			// Callbacks may remove the constraint from the world, so they run outside of the pass
+			for(Constraint *constraint : _brokenConstraints)
+			{
+				if(constraint->_callback)
+					constraint->_callback(constraint);
+				
+				constraint->Release();
+			}
+			
+			_brokenConstraints.clear();
+		}
 		
 		
+		
+		class ClosestRayResultWithShapeInfoCallback : public btCollisionWorld::ClosestRayResultCallback
+		{
+		public:
+			ClosestRayResultWithShapeInfoCallback(const btVector3 &from, const btVector3 &to) :
+				btCollisionWorld::ClosestRayResultCallback(from, to),
+				shapePart(-1),
+				triangleIndex(-1)
+			{}
+			
+			btScalar addSingleResult(btCollisionWorld::LocalRayResult &rayResult, bool normalInWorldSpace) override
+			{
+				shapePart = rayResult.m_localShapeInfo ? rayResult.m_localShapeInfo->m_shapePart : -1;
+				triangleIndex = rayResult.m_localShapeInfo ? rayResult.m_localShapeInfo->m_triangleIndex : -1;
+				
+				return btCollisionWorld::ClosestRayResultCallback::addSingleResult(rayResult, normalInWorldSpace);
+			}
+			
+			int shapePart;
+			int triangleIndex;
+		};
+		
 		Hit PhysicsWorld::CastRay(const Vector3 &from, const Vector3 &to)
 		{
 			btVector3 btRayFrom = btVector3(from.x, from.y, from.z);
 			btVector3 btRayTo   = btVector3(to.x, to.y, to.z);
 			
-			btCollisionWorld::ClosestRayResultCallback rayCallback(btRayFrom, btRayTo);
+			ClosestRayResultWithShapeInfoCallback rayCallback(btRayFrom, btRayTo);
 			
 			Lock();
 			_dynamicsWorld->rayTest(btRayFrom, btRayTo, rayCallback);
@@ -109,7 +991,7 @@ namespace RN
 			{
 				CollisionObject *body = reinterpret_cast<CollisionObject *>(rayCallback.m_collisionObject->getUserPointer());
 				
-				hit.node     = body->GetParent();
+				hit.node     = body->GetHitNode(rayCallback.shapePart, rayCallback.triangleIndex);
 				hit.position = Vector3(rayCallback.m_hitPointWorld.x(), rayCallback.m_hitPointWorld.y(), rayCallback.m_hitPointWorld.z());
 				hit.normal   = Vector3(rayCallback.m_hitNormalWorld.x(), rayCallback.m_hitNormalWorld.y(), rayCallback.m_hitNormalWorld.z());
 				hit.distance = hit.position.GetDistance(from);
@@ -122,6 +1004,13 @@ namespace RN
 		void PhysicsWorld::InsertCollisionObject(CollisionObject *attachment)
 		{
 			LockGuard<PhysicsWorld *> lock(this);
+			AllocatorScope scope(_arena);
+			
+			if(!attachment->CanInsertIntoWorld(this))
+			{
+				RNDebug("Collision object %p can't be inserted into physics world %p", attachment, this);
+				return;
+			}
 			
 			auto iterator = _collisionObjects.find(attachment);
 			if(iterator == _collisionObjects.end())
@@ -134,12 +1023,294 @@ namespace RN
 		void PhysicsWorld::RemoveCollisionObject(CollisionObject *attachment)
 		{
 			LockGuard<PhysicsWorld *> lock(this);
+			AllocatorScope scope(_arena);
 			
 			auto iterator = _collisionObjects.find(attachment);
 			if(iterator != _collisionObjects.end())
 			{
 				attachment->RemoveFromWorld(this);
+				attachment->_sleeping = false;
+				
 				_collisionObjects.erase(attachment);
+				_sleepEvents.erase(std::remove_if(_sleepEvents.begin(), _sleepEvents.end(), [&](const SleepEvent &event) {
+					return (event.object == attachment);
+				}), _sleepEvents.end());
+			}
+		}
+		
+		
+		void PhysicsWorld::InsertCollisionObjects(const std::vector<CollisionObject *> &objects)
+		{
+			LockGuard<PhysicsWorld *> lock(this);
+			AllocatorScope scope(_arena);
+			
+			btDbvtBroadphase *broadphase = static_cast<btDbvtBroadphase *>(_broadphase);
+			btCollisionObjectArray &collisionObjects = _dynamicsWorld->getCollisionObjectArray();
+			
+			_collisionObjects.reserve(_collisionObjects.size() + objects.size());
+			collisionObjects.reserve(collisionObjects.size() + static_cast<int>(objects.size()));
+			
+			// New proxies skip their individual pair query, the next step collides the trees against each other instead
+			broadphase->m_deferedcollide = true;
+			_deferredBroadphase = true;
+			
+			for(CollisionObject *object : objects)
+			{
+				if(!object->CanInsertIntoWorld(this))
+				{
+					RNDebug("Collision object %p can't be inserted into physics world %p", object, this);
+					continue;
+				}
+				
+				if(_collisionObjects.insert(object).second)
+					object->InsertIntoWorld(this);
+			}
+			
+			// The broadphase rebalances the dynamic set incrementally every step, a full rebuild here would cost more than the insertion
+		}
+		
+		void PhysicsWorld::RemoveCollisionObjects(const std::vector<CollisionObject *> &objects)
+		{
+			LockGuard<PhysicsWorld *> lock(this);
+			AllocatorScope scope(_arena);
+			
+			std::unordered_set<CollisionObject *> removed;
+			removed.reserve(objects.size());
+			
+			for(CollisionObject *object : objects)
+			{
+				if(_collisionObjects.find(object) != _collisionObjects.end())
+					removed.insert(object);
+			}
+			
+			if(removed.empty())
+				return;
+			
+			btDbvtBroadphase *broadphase = static_cast<btDbvtBroadphase *>(_broadphase);
+			btOverlappingPairCache *pairCache = broadphase->m_paircache;
+			btBroadphasePairArray &pairs = pairCache->getOverlappingPairArray();
+			
+			// Drop all pairs of the removed objects in one scan instead of one scan of the whole cache per proxy
+			std::vector<std::pair<btBroadphaseProxy *, btBroadphaseProxy *>> stalePairs;
+			
+			for(int i = 0; i < pairs.size(); i ++)
+			{
+				btBroadphasePair &pair = pairs[i];
+				
+				CollisionObject *objectA = static_cast<CollisionObject *>(static_cast<btCollisionObject *>(pair.m_pProxy0->m_clientObject)->getUserPointer());
+				CollisionObject *objectB = static_cast<CollisionObject *>(static_cast<btCollisionObject *>(pair.m_pProxy1->m_clientObject)->getUserPointer());
+				
+				if(removed.find(objectA) != removed.end() || removed.find(objectB) != removed.end())
+					stalePairs.emplace_back(pair.m_pProxy0, pair.m_pProxy1);
+			}
+			
+			for(auto &pair : stalePairs)
+				pairCache->removeOverlappingPair(pair.first, pair.second, _dispatcher);
+			
+			// With the pairs gone the per proxy cleanup has nothing left to do
+			btNullPairCache nullPairCache;
+			broadphase->m_paircache = &nullPairCache;
+			
+			for(CollisionObject *object : removed)
+			{
+				object->RemoveFromWorld(this);
+				object->_sleeping = false;
+				
+				_collisionObjects.erase(object);
+			}
+			
+			broadphase->m_paircache = pairCache;
+			
+			_sleepEvents.erase(std::remove_if(_sleepEvents.begin(), _sleepEvents.end(), [&](const SleepEvent &event) {
+				return (removed.find(event.object) != removed.end());
+			}), _sleepEvents.end());
+		}
+		
+		
+		class FilterPairCollector : public btDbvt::ICollide
+		{
+		public:
+			FilterPairCollector(btBroadphaseProxy *proxy, btHashedOverlappingPairCache *pairCache, btDispatcher *dispatcher) :
+				_proxy(proxy),
+				_pairCache(pairCache),
+				_dispatcher(dispatcher)
+			{}
+			
+			void Process(const btDbvtNode *leaf) override
+			{
+				btBroadphaseProxy *other = static_cast<btBroadphaseProxy *>(leaf->data);
+				if(other == _proxy)
+					return;
+				
+				bool exists = (_pairCache->findPair(_proxy, other) != nullptr);
+				bool needed = _pairCache->needsBroadphaseCollision(_proxy, other);
+				
+				if(exists && !needed)
+					_pairCache->removeOverlappingPair(_proxy, other, _dispatcher);
+				
+				if(!exists && needed)
+					_pairCache->addOverlappingPair(_proxy, other);
+			}
+			
+		private:
+			btBroadphaseProxy *_proxy;
+			btHashedOverlappingPairCache *_pairCache;
+			btDispatcher *_dispatcher;
+		};
+		
+		class LayerPairCollector : public btDbvt::ICollide
+		{
+		public:
+			LayerPairCollector(btOverlappingPairCache *pairCache) :
+				_pairCache(pairCache)
+			{}
+			
+			void Process(const btDbvtNode *leaf0, const btDbvtNode *leaf1) override
+			{
+				btBroadphaseProxy *proxy0 = static_cast<btBroadphaseProxy *>(leaf0->data);
+				btBroadphaseProxy *proxy1 = static_cast<btBroadphaseProxy *>(leaf1->data);
+				
+				// Adding checks the filters and layers and leaves existing pairs alone
+				if(proxy0 != proxy1)
+					_pairCache->addOverlappingPair(proxy0, proxy1);
+			}
+			
+		private:
+			btOverlappingPairCache *_pairCache;
+		};
+		
+		void PhysicsWorld::UpdateCollisionFilter(btCollisionObject *object, short int filter, short int mask)
+		{
+			LockGuard<PhysicsWorld *> lock(this);
+			
+			btBroadphaseProxy *proxy = object->getBroadphaseHandle();
+			if(!proxy)
+				return;
+			
+			proxy->m_collisionFilterGroup = filter;
+			proxy->m_collisionFilterMask = mask;
+			
+			// Only proxies overlapping the leaf can have or gain a pair, pairs are defined on the fattened leaf volumes
+			btDbvtBroadphase *broadphase = static_cast<btDbvtBroadphase *>(_broadphase);
+			const btDbvtVolume &volume = static_cast<btDbvtProxy *>(proxy)->leaf->volume;
+			
+			FilterPairCollector collector(proxy, static_cast<btHashedOverlappingPairCache *>(broadphase->getOverlappingPairCache()), _dispatcher);
+			
+			broadphase->m_sets[0].collideTV(broadphase->m_sets[0].m_root, volume, collector);
+			broadphase->m_sets[1].collideTV(broadphase->m_sets[1].m_root, volume, collector);
+		}
+		
+		
+		void PhysicsWorld::SetLayerName(uint32 layer, const std::string &name)
+		{
+			if(layer >= MaxLayers)
+				return;
+			
+			_layerNames[layer] = name;
+		}
+		
+		const std::string &PhysicsWorld::GetLayerName(uint32 layer) const
+		{
+			static std::string empty;
+			return (layer < MaxLayers) ? _layerNames[layer] : empty;
+		}
+		
+		uint32 PhysicsWorld::GetLayerMask(uint32 layer) const
+		{
+			return (layer < MaxLayers) ? _layerMatrix[layer] : 0;
+		}
+		
+		bool PhysicsWorld::GetLayersCollide(uint32 layerA, uint32 layerB) const
+		{
+			if(layerA >= MaxLayers || layerB >= MaxLayers)
+				return false;
+			
+			return (_layerMatrix[layerA] & (1u << layerB));
+		}
+		
+		uint32 PhysicsWorld::GetLayerWithName(const std::string &name) const
+		{
+			for(uint32 i = 0; i < MaxLayers; i ++)
+			{
+				if(_layerNames[i] == name)
+					return i;
+			}
+			
+			return MaxLayers;
+		}
+		
+		void PhysicsWorld::SetLayersCollide(uint32 layerA, uint32 layerB, bool collide)
+		{
+			if(layerA >= MaxLayers || layerB >= MaxLayers)
+				return;
+			
+			LockGuard<PhysicsWorld *> lock(this);
+			AllocatorScope scope(_arena);
+			
+			if(collide == GetLayersCollide(layerA, layerB))
+				return;
+			
+			if(collide)
+			{
+				_layerMatrix[layerA] |= (1u << layerB);
+				_layerMatrix[layerB] |= (1u << layerA);
+				
+				// Find the pairs that are allowed now right away, Bullet's deferred pass would skip pairs of two resting proxies
+				btDbvtBroadphase *broadphase = static_cast<btDbvtBroadphase *>(_broadphase);
+				LayerPairCollector collector(broadphase->getOverlappingPairCache());
+				
+				broadphase->m_sets[0].collideTT(broadphase->m_sets[0].m_root, broadphase->m_sets[0].m_root, collector);
+				broadphase->m_sets[0].collideTT(broadphase->m_sets[0].m_root, broadphase->m_sets[1].m_root, collector);
+				broadphase->m_sets[1].collideTT(broadphase->m_sets[1].m_root, broadphase->m_sets[1].m_root, collector);
+				
+				return;
+			}
+			
+			_layerMatrix[layerA] &= ~(1u << layerB);
+			_layerMatrix[layerB] &= ~(1u << layerA);
+			
+			btHashedOverlappingPairCache *pairCache = static_cast<btHashedOverlappingPairCache *>(_broadphase->getOverlappingPairCache());
+			btBroadphasePairArray &pairs = pairCache->getOverlappingPairArray();
+			
+			std::vector<std::pair<btBroadphaseProxy *, btBroadphaseProxy *>> stalePairs;
+			
+			for(int i = 0; i < pairs.size(); i ++)
+			{
+				btBroadphasePair &pair = pairs[i];
+				
+				if(!pairCache->needsBroadphaseCollision(pair.m_pProxy0, pair.m_pProxy1))
+					stalePairs.emplace_back(pair.m_pProxy0, pair.m_pProxy1);
+			}
+			
+			for(auto &pair : stalePairs)
+				pairCache->removeOverlappingPair(pair.first, pair.second, _dispatcher);
+		}
+		
+		
+		void PhysicsWorld::InsertConstraint(Constraint *constraint)
+		{
+			LockGuard<PhysicsWorld *> lock(this);
+			AllocatorScope scope(_arena);
+			
+			auto iterator = _constraints.find(constraint);
+			if(iterator == _constraints.end())
+			{
+				constraint->InsertIntoWorld(this);
+				_constraints.insert(constraint->Retain());
+			}
+		}
+		
+		void PhysicsWorld::RemoveConstraint(Constraint *constraint)
+		{
+			LockGuard<PhysicsWorld *> lock(this);
+			AllocatorScope scope(_arena);
+			
+			auto iterator = _constraints.find(constraint);
+			if(iterator != _constraints.end())
+			{
+				constraint->RemoveFromWorld(this);
+				_constraints.erase(iterator);
+				constraint->Release();
 			}
 		}
 	}
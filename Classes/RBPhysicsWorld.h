@@ -20,29 +20,155 @@
 
 #include <Rayne/Rayne.h>
 #include <btBulletDynamicsCommon.h>
+#include <BulletDynamics/Featherstone/btMultiBodyDynamicsWorld.h>
+#include <BulletDynamics/MLCPSolvers/btMLCPSolverInterface.h>
 #include "RBCollisionObject.h"
+#include "RBConstraint.h"
+#include "RBAllocator.h"
 
 namespace RN
 {
 	namespace bullet
 	{
+		class VehicleBatch;
+		class CrowdController;
+		class TriggerVolume;
+		class DebugRecorder;
+		class WorldPartition;
+		class DesyncRecorder;
+		
 		class PhysicsWorld : public WorldAttachment, public INonConstructingSingleton<PhysicsWorld>
 		{
 		public:
-			PhysicsWorld(const Vector3 &gravity = Vector3(0.0f, -9.81f, 0.0f));
+			friend class TriggerVolume;
+			friend class CollisionObject;
+			
+			enum
+			{
+				MaxLayers = 32
+			};
+			
+			enum : uint32
+			{
+				NoMaterial = 0xffffffff
+			};
+			
+			struct SleepEvent
+			{
+				CollisionObject *object;
+				bool sleeping;
+			};
+			
+			// Estimated bytes per category, most transient data lives in the reserved arena chunks
+			struct MemoryStats
+			{
+				size_t shapes;
+				size_t shapeCount;
+				size_t objects;
+				size_t constraints;
+				size_t broadphase;
+				size_t pairCache;
+				size_t manifolds;
+				size_t arenaReserved;
+				size_t total;
+			};
+			
+			enum class Solver
+			{
+				SequentialImpulse,
+				MLCPDantzig,
+				MLCPProjectedGaussSeidel
+			};
+			
+			// Articulated worlds always use the multi body solver, the solver argument and SetSolver() are ignored for them
+			// and GetSolver() keeps reporting SequentialImpulse
+			PhysicsWorld(const Vector3 &gravity = Vector3(0.0f, -9.81f, 0.0f), bool articulated = false, Solver solver = Solver::SequentialImpulse);
 			~PhysicsWorld() override;
 			
 			void SetGravity(const Vector3 &gravity);
 			
+			// Collision objects added to a scene resolve their physics world through the scene's world
+			void BindToWorld(World *world);
+			World *GetBoundWorld() const { return _world; }
+			
+			static PhysicsWorld *GetPhysicsWorld(World *world);
+			
+			// Steps independent worlds, each under its own lock. They are only stepped in parallel on the shared thread pool
+			// when Bullet is built with BT_NO_PROFILE, the vendored build isn't, so by default they are stepped one after another
+			static void StepWorlds(const std::vector<PhysicsWorld *> &worlds, float delta);
+			
 			void StepWorld(float delta) override;
 			void SetStepSize(double stepsize, int maxsteps);
 			
+			void SetSolver(Solver solver);
+			void SetSolverIterations(int iterations);
+			void SetSolverSOR(float sor);
+			void SetWarmStarting(bool enabled, float factor = 0.85f);
+			void SetSplitImpulse(bool enabled, float penetrationThreshold = -0.04f);
+			
+			Solver GetSolver() const { return _solver; }
+			int GetSolverIterations() const;
+			
+			// Allocation counters are reset at the start of every step, zero unless Allocator::Install() was called
+			AllocatorArena::Statistics GetAllocatorStatistics() const;
+			
+			MemoryStats GetMemoryStats();
+			
+			// Checked every interval steps, the callback fires once each time the total rises above the budget
+			void SetMemoryBudget(size_t budget, std::function<void (PhysicsWorld *, const MemoryStats &)> &&callback, uint32 interval = 60);
+			
+			// Sleep and wake transitions of the last step, valid until the next one
+			const std::vector<SleepEvent> &GetSleepEvents() const { return _sleepEvents; }
+			
+			// The recorder captures the world after every step
+			void SetDebugRecorder(DebugRecorder *recorder);
+			DebugRecorder *GetDebugRecorder() const { return _debugRecorder; }
+			
+			// Not retained, the partition retains the world and clears itself here when it goes away.
+			// Its Update() has to be called from the game thread
+			void SetWorldPartition(WorldPartition *partition);
+			WorldPartition *GetWorldPartition() const { return _worldPartition; }
+			
+			// Hashes transforms, velocities and activation states of all rigid bodies after every simulation step
+			void SetChecksumEnabled(bool enabled);
+			bool IsChecksumEnabled() const { return _checksumEnabled; }
+			uint64 GetChecksum() const { return _checksum; }
+			uint32 GetChecksumStep() const { return _checksumStep; }
+			
+			// Enables checksums, the recorder also receives a hash per body in the order of the world's body array
+			void SetDesyncRecorder(DesyncRecorder *recorder);
+			DesyncRecorder *GetDesyncRecorder() const { return _desyncRecorder; }
+			
 			Hit CastRay(const Vector3 &from, const Vector3 &to);
 			
 			void InsertCollisionObject(CollisionObject *attachment);
 			void RemoveCollisionObject(CollisionObject *attachment);
 			
+			// Take the lock once and leave pair finding to a single tree against tree pass in the next step
+			void InsertCollisionObjects(const std::vector<CollisionObject *> &objects);
+			void RemoveCollisionObjects(const std::vector<CollisionObject *> &objects);
+			
+			// Changes the filter of a proxy in place and only touches the pairs its bounds overlap
+			void UpdateCollisionFilter(btCollisionObject *object, short int filter, short int mask);
+			
+			// Layers are checked on top of the collision filters, by default every layer collides with every other
+			void SetLayerName(uint32 layer, const std::string &name);
+			void SetLayersCollide(uint32 layerA, uint32 layerB, bool collide);
+			
+			const std::string &GetLayerName(uint32 layer) const;
+			uint32 GetLayerWithName(const std::string &name) const;
+			uint32 GetLayerMask(uint32 layer) const;
+			bool GetLayersCollide(uint32 layerA, uint32 layerB) const;
+			
+			void InsertConstraint(Constraint *constraint);
+			void RemoveConstraint(Constraint *constraint);
+			
+			bool IsArticulated() const { return _articulated; }
+			VehicleBatch *GetVehicleBatch();
+			CrowdController *GetCrowdController();
+			
 			btDynamicsWorld *GetBulletDynamicsWorld() { return _dynamicsWorld; }
+			btMultiBodyDynamicsWorld *GetBulletMultiBodyWorld() { return _articulated ? static_cast<btMultiBodyDynamicsWorld *>(_dynamicsWorld) : nullptr; }
 			
 		private:
 			btDynamicsWorld *_dynamicsWorld;
@@ -50,14 +176,86 @@ namespace RN
 			btCollisionConfiguration *_collisionConfiguration;
 			btCollisionDispatcher *_dispatcher;
 			btConstraintSolver *_constraintSolver;
+			btMLCPSolverInterface *_mlcpSolver;
 			btOverlappingPairCallback *_pairCallback;
+			btOverlapFilterCallback *_layerFilterCallback;
+			VehicleBatch *_vehicleBatch;
+			CrowdController *_crowdController;
+			DebugRecorder *_debugRecorder;
+			WorldPartition *_worldPartition;
+			DesyncRecorder *_desyncRecorder;
+			World *_world;
+			AllocatorArena *_arena;
 			
 			static void SimulationStepTickCallback(btDynamicsWorld *world, btScalar timeStep);
+			static void NearCallback(btBroadphasePair &pair, btCollisionDispatcher &dispatcher, const btDispatcherInfo &info);
+			static bool ContactAddedCallback(btManifoldPoint &point, const btCollisionObjectWrapper *wrapper0, int part0, int index0, const btCollisionObjectWrapper *wrapper1, int part1, int index1);
+			void UpdateBrokenConstraints();
+			void UpdateSleepEvents();
+			void UpdateTriggers();
+			void UpdateMemoryBudget();
+			void UpdateChecksum();
+			
+			// Laid out as whole 16 byte blocks for the hash
+			struct BodyState
+			{
+				float position[3];
+				float basis[9];
+				float linearVelocity[3];
+				float angularVelocity[3];
+				uint32 activation;
+				uint32 padding;
+			};
+			btConstraintSolver *CreateConstraintSolver(Solver solver);
+			
+			struct MaterialPair
+			{
+				float friction;
+				float restitution;
+			};
+			
+			uint32 RegisterMaterial(PhysicsMaterial *material);
+			void UnregisterMaterial(uint32 index);
+			void MaterialDidChange(uint32 index);
+			void UpdateMaterialPairs(uint32 index);
+			void UpdateMaterialDamping();
 			
 			double _stepSize;
 			int _maxSteps;
+			bool _articulated;
+			bool _deferredBroadphase;
+			Solver _solver;
+			bool _hasChangedMaterials;
+			
+			uint32 _layerMatrix[MaxLayers];
+			std::string _layerNames[MaxLayers];
 			
 			std::unordered_set<CollisionObject *> _collisionObjects;
+			std::unordered_set<Constraint *> _constraints;
+			std::vector<Constraint *> _brokenConstraints;
+			std::vector<SleepEvent> _sleepEvents;
+			std::unordered_set<TriggerVolume *> _triggers;
+			std::vector<TriggerVolume *> _firingTriggers;
+			
+			std::vector<PhysicsMaterial *> _materials;
+			std::vector<Connection *> _materialConnections;
+			std::unordered_map<PhysicsMaterial *, uint32> _materialIndices;
+			std::vector<uint32> _materialUseCounts;
+			std::vector<uint32> _freeMaterialSlots;
+			std::vector<bool> _materialsChanged;
+			std::vector<MaterialPair> _materialPairs;
+			
+			size_t _memoryBudget;
+			uint32 _memoryBudgetInterval;
+			uint32 _memoryBudgetCounter;
+			bool _memoryBudgetExceeded;
+			std::function<void (PhysicsWorld *, const MemoryStats &)> _memoryBudgetCallback;
+			
+			bool _checksumEnabled;
+			uint64 _checksum;
+			uint32 _checksumStep;
+			std::vector<BodyState> _checksumSnapshot;
+			std::vector<uint32> _bodyChecksums;
 			
 			RNDeclareMeta(PhysicsWorld)
 			RNDeclareSingleton(PhysicsWorld)
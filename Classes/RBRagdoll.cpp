@@ -0,0 +1,406 @@
+//
+//  RBRagdoll.cpp
+//  rayne-bullet
+//
+//  Copyright 2013 by Überpixel. All rights reserved.
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "RBRagdoll.h"
+#include "RBPhysicsWorld.h"
+
+namespace RN
+{
+	namespace bullet
+	{
+		RNDefineMeta(RagdollDefinition, Object)
+		RNDefineMeta(Ragdoll, Object)
+		RNDefineMeta(RagdollPool, Object)
+		
+		RagdollBone::RagdollBone(size_t tparent, const Vector3 &tposition, const Quaternion &trotation, float tradius, float theight, float tmass) :
+			parent(tparent),
+			position(tposition),
+			rotation(trotation),
+			radius(tradius),
+			height(theight),
+			mass(tmass),
+			jointPosition(tposition),
+			jointRotation(trotation),
+			swingSpan1(0.785f),
+			swingSpan2(0.785f),
+			twistSpan(0.35f)
+		{}
+		
+		
+		
+		RagdollDefinition::RagdollDefinition()
+		{}
+		
+		RagdollDefinition::~RagdollDefinition()
+		{
+			for(Shape *shape : _shapes)
+				shape->Release();
+		}
+		
+		size_t RagdollDefinition::AddBone(const RagdollBone &bone)
+		{
+			_bones.push_back(bone);
+			_shapes.push_back(new CapsuleShape(bone.radius, bone.height));
+			
+			return _bones.size() - 1;
+		}
+		
+		
+		
+		Ragdoll::Ragdoll(RagdollDefinition *definition) :
+			_definition(definition->Retain()),
+			_pool(nullptr),
+			_world(nullptr),
+			_active(false),
+			_parked(false)
+		{
+			size_t count = _definition->GetBoneCount();
+			
+			_nodes.reserve(count);
+			_bodies.reserve(count);
+			_joints.reserve(count);
+			
+			for(size_t i = 0; i < count; i ++)
+			{
+				const RagdollBone &bone = _definition->GetBone(i);
+				
+				SceneNode *node = new SceneNode();
+				node->SetWorldPosition(bone.position);
+				node->SetWorldRotation(bone.rotation);
+				
+				RigidBody *body = new RigidBody(_definition->GetShape(i), bone.mass);
+				node->AddAttachment(body);
+				
+				// Attaching registers the body with the shared world, pooled ragdolls stay out of the simulation until they are activated
+				PhysicsWorld *owner = body->GetOwner();
+				if(owner)
+					owner->RemoveCollisionObject(body);
+				
+				_nodes.push_back(node);
+				_bodies.push_back(body);
+			}
+			
+			for(size_t i = 0; i < count; i ++)
+			{
+				const RagdollBone &bone = _definition->GetBone(i);
+				
+				if(bone.parent == RagdollBone::NoParent)
+				{
+					_joints.push_back(nullptr);
+					continue;
+				}
+				
+				const RagdollBone &parent = _definition->GetBone(bone.parent);
+				
+				btTransform joint(btQuaternion(bone.jointRotation.x, bone.jointRotation.y, bone.jointRotation.z, bone.jointRotation.w), btVector3(bone.jointPosition.x, bone.jointPosition.y, bone.jointPosition.z));
+				btTransform frameA(btQuaternion(parent.rotation.x, parent.rotation.y, parent.rotation.z, parent.rotation.w), btVector3(parent.position.x, parent.position.y, parent.position.z));
+				btTransform frameB(btQuaternion(bone.rotation.x, bone.rotation.y, bone.rotation.z, bone.rotation.w), btVector3(bone.position.x, bone.position.y, bone.position.z));
+				
+				frameA = frameA.inverse() * joint;
+				frameB = frameB.inverse() * joint;
+				
+				btQuaternion rotationA = frameA.getRotation();
+				btQuaternion rotationB = frameB.getRotation();
+				btVector3 &pivotA = frameA.getOrigin();
+				btVector3 &pivotB = frameB.getOrigin();
+				
+				ConeTwistConstraint *constraint = new ConeTwistConstraint(_bodies[bone.parent], Vector3(pivotA.x(), pivotA.y(), pivotA.z()), Quaternion(rotationA.x(), rotationA.y(), rotationA.z(), rotationA.w()),
+																		  _bodies[i], Vector3(pivotB.x(), pivotB.y(), pivotB.z()), Quaternion(rotationB.x(), rotationB.y(), rotationB.z(), rotationB.w()));
+				constraint->SetLimit(bone.swingSpan1, bone.swingSpan2, bone.twistSpan);
+				
+				_joints.push_back(constraint);
+			}
+		}
+		
+		Ragdoll::~Ragdoll()
+		{
+			Deactivate();
+			
+			for(ConeTwistConstraint *joint : _joints)
+			{
+				if(joint)
+					joint->Release();
+			}
+			
+			for(size_t i = 0; i < _bodies.size(); i ++)
+			{
+				_bodies[i]->Release();
+				_nodes[i]->Release();
+			}
+			
+			_definition->Release();
+		}
+		
+		Ragdoll *Ragdoll::WithDefinition(RagdollDefinition *definition)
+		{
+			Ragdoll *ragdoll = new Ragdoll(definition);
+			return ragdoll->Autorelease();
+		}
+		
+		
+		void Ragdoll::ResetBody(size_t index, const Vector3 &position, const Quaternion &rotation)
+		{
+			RigidBody *body = _bodies[index];
+			
+			_nodes[index]->SetWorldPosition(position);
+			_nodes[index]->SetWorldRotation(rotation);
+			
+			body->SetLinearVelocity(Vector3());
+			body->SetAngularVelocity(Vector3());
+			body->ClearForces();
+			
+			btRigidBody *rigidBody = body->GetBulletRigidBody();
+			rigidBody->forceActivationState(ACTIVE_TAG);
+			rigidBody->setDeactivationTime(0.0f);
+		}
+		
+		void Ragdoll::Activate(PhysicsWorld *world, const Vector3 &position, const Quaternion &rotation)
+		{
+			if(_world != world || !_parked)
+				Deactivate();
+			
+			for(size_t i = 0; i < _bodies.size(); i ++)
+			{
+				const RagdollBone &bone = _definition->GetBone(i);
+				ResetBody(i, position + rotation.GetRotatedVector(bone.position), rotation * bone.rotation);
+			}
+			
+			InsertIntoWorld(world);
+		}
+		
+		void Ragdoll::Activate(PhysicsWorld *world, const Vector3 *positions, const Quaternion *rotations)
+		{
+			if(_world != world || !_parked)
+				Deactivate();
+			
+			for(size_t i = 0; i < _bodies.size(); i ++)
+				ResetBody(i, positions[i], rotations[i]);
+			
+			InsertIntoWorld(world);
+		}
+		
+		void Ragdoll::InsertIntoWorld(PhysicsWorld *world)
+		{
+			world->Lock();
+			
+			_active = true;
+			
+			// A ragdoll parked in this world is still registered with it and only gets its filters and joints back
+			if(_parked)
+			{
+				_parked = false;
+				
+				for(RigidBody *body : _bodies)
+				{
+					btRigidBody *rigidBody = body->GetBulletRigidBody();
+					
+					world->GetBulletDynamicsWorld()->updateSingleAabb(rigidBody);
+					world->UpdateCollisionFilter(rigidBody, body->GetCollisionFilter(), body->GetCollisionFilterMask());
+				}
+				
+				for(ConeTwistConstraint *joint : _joints)
+				{
+					if(joint)
+						joint->SetEnabled(true);
+				}
+				
+				world->Unlock();
+				return;
+			}
+			
+			for(RigidBody *body : _bodies)
+				world->InsertCollisionObject(body);
+			
+			// Joints broken during the previous activation are restored with the pose
+			for(ConeTwistConstraint *joint : _joints)
+			{
+				if(joint)
+				{
+					joint->SetEnabled(true);
+					world->InsertConstraint(joint);
+				}
+			}
+			
+			world->Unlock();
+			
+			_world = world;
+		}
+		
+		void Ragdoll::Park()
+		{
+			if(!_world || _parked)
+				return;
+			
+			_world->Lock();
+			
+			// Parked ragdolls stay registered with their world so the next activation in it doesn't allocate
+			for(ConeTwistConstraint *joint : _joints)
+			{
+				if(joint)
+					joint->SetEnabled(false);
+			}
+			
+			btDynamicsWorld *dynamicsWorld = _world->GetBulletDynamicsWorld();
+			
+			for(RigidBody *body : _bodies)
+			{
+				btRigidBody *rigidBody = body->GetBulletRigidBody();
+				
+				rigidBody->forceActivationState(DISABLE_SIMULATION);
+				rigidBody->setLinearVelocity(btVector3(0.0f, 0.0f, 0.0f));
+				rigidBody->setAngularVelocity(btVector3(0.0f, 0.0f, 0.0f));
+				rigidBody->clearForces();
+				
+				btBroadphaseProxy *proxy = rigidBody->getBroadphaseHandle();
+				if(proxy)
+				{
+					proxy->m_collisionFilterGroup = 0;
+					proxy->m_collisionFilterMask = 0;
+					
+					dynamicsWorld->getBroadphase()->getOverlappingPairCache()->cleanProxyFromPairs(proxy, dynamicsWorld->getDispatcher());
+				}
+			}
+			
+			_world->Unlock();
+			
+			_active = false;
+			_parked = true;
+		}
+		
+		void Ragdoll::Deactivate()
+		{
+			_active = false;
+			_parked = false;
+			
+			if(!_world)
+				return;
+			
+			_world->Lock();
+			
+			for(ConeTwistConstraint *joint : _joints)
+			{
+				if(joint)
+					_world->RemoveConstraint(joint);
+			}
+			
+			for(RigidBody *body : _bodies)
+				_world->RemoveCollisionObject(body);
+			
+			_world->Unlock();
+			_world = nullptr;
+		}
+		
+		
+		void Ragdoll::BlendPose(const Vector3 *positions, const Quaternion *rotations, float weight, float delta)
+		{
+			if(!_world || weight <= 0.0f || delta <= 0.0f)
+				return;
+			
+			weight = std::min(weight, 1.0f);
+			
+			for(size_t i = 0; i < _bodies.size(); i ++)
+			{
+				btRigidBody *rigidBody = _bodies[i]->GetBulletRigidBody();
+				const btTransform &transform = rigidBody->getCenterOfMassTransform();
+				
+				btVector3 position = transform.getOrigin();
+				btQuaternion rotation = transform.getRotation();
+				
+				btVector3 targetPosition = position.lerp(btVector3(positions[i].x, positions[i].y, positions[i].z), weight);
+				btQuaternion targetRotation = rotation.slerp(btQuaternion(rotations[i].x, rotations[i].y, rotations[i].z, rotations[i].w), weight);
+				
+				// Velocities instead of teleports keep the joints and contacts consistent for the solver
+				btVector3 linearVelocity;
+				btVector3 angularVelocity;
+				btTransformUtil::calculateVelocityQuaternion(position, targetPosition, rotation, targetRotation, delta, linearVelocity, angularVelocity);
+				
+				rigidBody->setLinearVelocity(linearVelocity);
+				rigidBody->setAngularVelocity(angularVelocity);
+				rigidBody->activate();
+			}
+		}
+		
+		void Ragdoll::GetPose(Vector3 *positions, Quaternion *rotations) const
+		{
+			for(size_t i = 0; i < _nodes.size(); i ++)
+			{
+				positions[i] = _nodes[i]->GetWorldPosition();
+				rotations[i] = _nodes[i]->GetWorldRotation();
+			}
+		}
+		
+		
+		
+		RagdollPool::RagdollPool(RagdollDefinition *definition, size_t capacity)
+		{
+			_ragdolls.reserve(capacity);
+			_available.reserve(capacity);
+			
+			for(size_t i = 0; i < capacity; i ++)
+			{
+				Ragdoll *ragdoll = new Ragdoll(definition);
+				
+				_ragdolls.push_back(ragdoll);
+				_available.push_back(ragdoll);
+			}
+		}
+		
+		RagdollPool::~RagdollPool()
+		{
+			for(Ragdoll *ragdoll : _ragdolls)
+				ragdoll->Release();
+		}
+		
+		Ragdoll *RagdollPool::Acquire(PhysicsWorld *world, const Vector3 &position, const Quaternion &rotation)
+		{
+			if(_available.empty())
+				return nullptr;
+			
+			Ragdoll *ragdoll = _available.back();
+			_available.pop_back();
+			
+			ragdoll->_pool = this;
+			ragdoll->Activate(world, position, rotation);
+			return ragdoll;
+		}
+		
+		Ragdoll *RagdollPool::Acquire(PhysicsWorld *world, const Vector3 *positions, const Quaternion *rotations)
+		{
+			if(_available.empty())
+				return nullptr;
+			
+			Ragdoll *ragdoll = _available.back();
+			_available.pop_back();
+			
+			ragdoll->_pool = this;
+			ragdoll->Activate(world, positions, rotations);
+			return ragdoll;
+		}
+		
+		void RagdollPool::Relinquish(Ragdoll *ragdoll)
+		{
+			// Ragdolls of other pools and ones that were already returned are ignored
+			if(ragdoll->_pool != this)
+				return;
+			
+			ragdoll->_pool = nullptr;
+			ragdoll->Park();
+			
+			_available.push_back(ragdoll);
+		}
+	}
+}
@@ -0,0 +1,144 @@
+//
+//  RBRagdoll.h
+//  rayne-bullet
+//
+//  Copyright 2013 by Überpixel. All rights reserved.
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef __rayne_bullet__RBRagdoll__
+#define __rayne_bullet__RBRagdoll__
+
+#include <Rayne/Rayne.h>
+#include "RBRigidBody.h"
+#include "RBConstraint.h"
+#include "RBShape.h"
+
+namespace RN
+{
+	namespace bullet
+	{
+		class PhysicsWorld;
+		
+		struct RagdollBone
+		{
+			static const size_t NoParent = static_cast<size_t>(-1);
+			
+			RagdollBone(size_t parent, const Vector3 &position, const Quaternion &rotation, float radius, float height, float mass);
+			
+			// Position and rotation of the capsule center in ragdoll space, the capsule is aligned along its local y axis
+			size_t parent;
+			Vector3 position;
+			Quaternion rotation;
+			
+			float radius;
+			float height;
+			float mass;
+			
+			// Joint to the parent bone in ragdoll space, the twist axis is the local x axis of the joint
+			Vector3 jointPosition;
+			Quaternion jointRotation;
+			
+			float swingSpan1;
+			float swingSpan2;
+			float twistSpan;
+		};
+		
+		class RagdollDefinition : public Object
+		{
+		public:
+			RagdollDefinition();
+			~RagdollDefinition() override;
+			
+			size_t AddBone(const RagdollBone &bone);
+			
+			size_t GetBoneCount() const { return _bones.size(); }
+			const RagdollBone &GetBone(size_t index) const { return _bones[index]; }
+			Shape *GetShape(size_t index) const { return _shapes[index]; }
+			
+		private:
+			std::vector<RagdollBone> _bones;
+			std::vector<Shape *> _shapes;
+			
+			RNDeclareMeta(RagdollDefinition)
+		};
+		
+		class RagdollPool;
+		
+		class Ragdoll : public Object
+		{
+		public:
+			friend class RagdollPool;
+			
+			Ragdoll(RagdollDefinition *definition);
+			~Ragdoll() override;
+			
+			static Ragdoll *WithDefinition(RagdollDefinition *definition);
+			
+			void Activate(PhysicsWorld *world, const Vector3 &position, const Quaternion &rotation);
+			void Activate(PhysicsWorld *world, const Vector3 *positions, const Quaternion *rotations);
+			void Deactivate();
+			
+			// Drives the bodies towards the animated pose, weight 0 leaves the simulation untouched and 1 follows the animation
+			void BlendPose(const Vector3 *positions, const Quaternion *rotations, float weight, float delta);
+			void GetPose(Vector3 *positions, Quaternion *rotations) const;
+			
+			bool IsActive() const { return _active; }
+			
+			size_t GetBoneCount() const { return _bodies.size(); }
+			RigidBody *GetBody(size_t index) const { return _bodies[index]; }
+			SceneNode *GetNode(size_t index) const { return _nodes[index]; }
+			ConeTwistConstraint *GetJoint(size_t index) const { return _joints[index]; }
+			RagdollDefinition *GetDefinition() const { return _definition; }
+			
+		private:
+			void ResetBody(size_t index, const Vector3 &position, const Quaternion &rotation);
+			void InsertIntoWorld(PhysicsWorld *world);
+			void Park();
+			
+			RagdollDefinition *_definition;
+			RagdollPool *_pool;
+			PhysicsWorld *_world;
+			bool _active;
+			bool _parked;
+			
+			std::vector<SceneNode *> _nodes;
+			std::vector<RigidBody *> _bodies;
+			std::vector<ConeTwistConstraint *> _joints;
+			
+			RNDeclareMeta(Ragdoll)
+		};
+		
+		class RagdollPool : public Object
+		{
+		public:
+			RagdollPool(RagdollDefinition *definition, size_t capacity);
+			~RagdollPool() override;
+			
+			// Returns nullptr once all pooled ragdolls are in use
+			Ragdoll *Acquire(PhysicsWorld *world, const Vector3 &position, const Quaternion &rotation);
+			Ragdoll *Acquire(PhysicsWorld *world, const Vector3 *positions, const Quaternion *rotations);
+			void Relinquish(Ragdoll *ragdoll);
+			
+			size_t GetCapacity() const { return _ragdolls.size(); }
+			size_t GetAvailableCount() const { return _available.size(); }
+			
+		private:
+			std::vector<Ragdoll *> _ragdolls;
+			std::vector<Ragdoll *> _available;
+			
+			RNDeclareMeta(RagdollPool)
+		};
+	}
+}
+
+#endif /* defined(__rayne_bullet__RBRagdoll__) */
@@ -23,10 +23,13 @@ namespace RN
 	namespace bullet
 	{
 		RNDefineMeta(RigidBody, CollisionObject)
+		RNDefineMeta(RigidBodyPool, Object)
 		
 		RigidBody::RigidBody(Shape *shape, float mass) :
 			_shape(shape->Retain()),
-			_rigidBody(nullptr)
+			_rigidBody(nullptr),
+			_kinematic(false),
+			_dynamicMass(mass)
 		{
 			Vector3 inertia = _shape->CalculateLocalInertia(mass);
 			btVector3 btInertia = btVector3(inertia.x, inertia.y, inertia.z);
@@ -39,12 +42,15 @@ namespace RN
 		
 		RigidBody::RigidBody(Shape *shape, float mass, const Vector3 &inertia) :
 			_shape(shape->Retain()),
-			_rigidBody(nullptr)
+			_rigidBody(nullptr),
+			_kinematic(false),
+			_dynamicMass(mass)
 		{
 			btVector3 btInertia = btVector3(inertia.x, inertia.y, inertia.z);
 			btRigidBody::btRigidBodyConstructionInfo info(mass, this, _shape->GetBulletShape(), btInertia);
 			
 			_rigidBody = new btRigidBody(info);
+			_rigidBody->setUserPointer(this);
 		}
 		
 		RigidBody::~RigidBody()
@@ -73,6 +79,14 @@ namespace RN
 		}
 		void RigidBody::SetMass(float mass, const Vector3 &inertia)
 		{
+			// Kinematic bodies have to stay massless, the mass is applied when they turn dynamic again
+			if(_kinematic)
+			{
+				_dynamicMass = mass;
+				_dynamicInertia = inertia;
+				return;
+			}
+			
 			_rigidBody->setMassProps(mass, btVector3(inertia.x, inertia.y, inertia.z));
 		}
 		void RigidBody::SetLinearVelocity(const Vector3 &velocity)
@@ -102,6 +116,80 @@ namespace RN
 			_rigidBody->setDamping(linear, angular);
 		}
 		
+		void RigidBody::SetSleepingThresholds(float linear, float angular)
+		{
+			_rigidBody->setSleepingThresholds(linear, angular);
+		}
+		
+		void RigidBody::SetAllowsSleeping(bool allowsSleeping)
+		{
+			if(allowsSleeping == AllowsSleeping())
+				return;
+			
+			_rigidBody->forceActivationState(allowsSleeping ? ACTIVE_TAG : DISABLE_DEACTIVATION);
+			_rigidBody->setDeactivationTime(0.0f);
+		}
+		
+		void RigidBody::SetKinematic(bool kinematic)
+		{
+			if(kinematic == _kinematic)
+				return;
+			
+			_kinematic = kinematic;
+			
+			if(_kinematic)
+			{
+				btScalar inverseMass = _rigidBody->getInvMass();
+				const btVector3 &inverseInertia = _rigidBody->getInvInertiaDiagLocal();
+				
+				_dynamicMass = (inverseMass > 0.0f) ? 1.0f / inverseMass : 0.0f;
+				_dynamicInertia = Vector3((inverseInertia.x() > 0.0f) ? 1.0f / inverseInertia.x() : 0.0f,
+										  (inverseInertia.y() > 0.0f) ? 1.0f / inverseInertia.y() : 0.0f,
+										  (inverseInertia.z() > 0.0f) ? 1.0f / inverseInertia.z() : 0.0f);
+				
+				_rigidBody->setMassProps(0.0f, btVector3(0.0f, 0.0f, 0.0f));
+				_rigidBody->setCollisionFlags(_rigidBody->getCollisionFlags() | btCollisionObject::CF_KINEMATIC_OBJECT);
+				
+				_rigidBody->setLinearVelocity(btVector3(0.0f, 0.0f, 0.0f));
+				_rigidBody->setAngularVelocity(btVector3(0.0f, 0.0f, 0.0f));
+			}
+			else
+			{
+				_rigidBody->setCollisionFlags(_rigidBody->getCollisionFlags() & ~btCollisionObject::CF_KINEMATIC_OBJECT);
+				_rigidBody->setMassProps(_dynamicMass, btVector3(_dynamicInertia.x, _dynamicInertia.y, _dynamicInertia.z));
+			}
+			
+			_rigidBody->forceActivationState(ACTIVE_TAG);
+			
+			// Bullet only sets up gravity and the dynamic body list when a body is added
+			ReInsertIntoWorld();
+		}
+		
+		void RigidBody::Sleep()
+		{
+			if(!AllowsSleeping())
+				return;
+			
+			_rigidBody->setLinearVelocity(btVector3(0.0f, 0.0f, 0.0f));
+			_rigidBody->setAngularVelocity(btVector3(0.0f, 0.0f, 0.0f));
+			_rigidBody->setActivationState(ISLAND_SLEEPING);
+		}
+		
+		void RigidBody::WakeUp()
+		{
+			_rigidBody->activate(true);
+		}
+		
+		bool RigidBody::IsSleeping() const
+		{
+			return (_rigidBody->getActivationState() == ISLAND_SLEEPING);
+		}
+		
+		bool RigidBody::AllowsSleeping() const
+		{
+			return (_rigidBody->getActivationState() != DISABLE_DEACTIVATION);
+		}
+		
 		Vector3 RigidBody::GetLinearVelocity() const
 		{
 			const btVector3& velocity = _rigidBody->getLinearVelocity();
@@ -135,6 +223,25 @@ namespace RN
 		}
 		
 		
+		void RigidBody::ResetState()
+		{
+			btTransform transform;
+			getWorldTransform(transform);
+			
+			_rigidBody->setCenterOfMassTransform(transform);
+			_rigidBody->setInterpolationWorldTransform(transform);
+			
+			_rigidBody->setLinearVelocity(btVector3(0.0f, 0.0f, 0.0f));
+			_rigidBody->setAngularVelocity(btVector3(0.0f, 0.0f, 0.0f));
+			_rigidBody->setInterpolationLinearVelocity(btVector3(0.0f, 0.0f, 0.0f));
+			_rigidBody->setInterpolationAngularVelocity(btVector3(0.0f, 0.0f, 0.0f));
+			_rigidBody->clearForces();
+			
+			_rigidBody->setDeactivationTime(0.0f);
+			_rigidBody->forceActivationState(ACTIVE_TAG);
+		}
+		
+		
 		void RigidBody::ApplyForce(const Vector3 &force)
 		{
 			_rigidBody->applyCentralForce(btVector3(force.x, force.y, force.z));
@@ -174,6 +281,13 @@ namespace RN
 			
 			if(changeSet & SceneNode::ChangeSet::Position)
 			{
+				// Kinematic poses are pulled from the motion state at the next step, which also derives their velocity
+				if(_kinematic)
+				{
+					_rigidBody->activate(true);
+					return;
+				}
+				
 				btTransform transform;
 				
 				getWorldTransform(transform);
@@ -182,8 +296,6 @@ namespace RN
 		}
 		void RigidBody::UpdateFromMaterial(PhysicsMaterial *material)
 		{
-			_rigidBody->setFriction(material->GetFriction());
-			_rigidBody->setRestitution(material->GetRestitution());
 			_rigidBody->setDamping(material->GetLinearDamping(), material->GetAngularDamping());
 		}
 		
@@ -222,6 +334,7 @@ namespace RN
 			
 			worldTrans.setRotation(btQuaternion(rotation.x, rotation.y, rotation.z, rotation.w));
 			worldTrans.setOrigin(btVector3(position.x, position.y, position.z));
+			worldTrans = worldTrans * _shape->GetPrincipalTransform();
 		}
 		
 		void RigidBody::setWorldTransform(const btTransform &worldTrans)
@@ -229,11 +342,176 @@ namespace RN
 			if(!GetParent())
 				return;
 			
-			btQuaternion rotation = worldTrans.getRotation();
-			btVector3 position    = worldTrans.getOrigin();
+			btTransform transform = worldTrans * _shape->GetPrincipalTransform().inverse();
+			
+			btQuaternion rotation = transform.getRotation();
+			btVector3 position    = transform.getOrigin();
 			
 			SetWorldRotation(Quaternion(rotation.x(), rotation.y(), rotation.z(), rotation.w()));
 			SetWorldPosition(Vector3(position.x(), position.y(), position.z()) + GetWorldRotation().GetRotatedVector(offset));
 		}
+		
+		
+		
+		RigidBodyPool::RigidBodyPool(float massGranularity) :
+			_massGranularity(massGranularity),
+			_availableCount(0)
+		{}
+		
+		RigidBodyPool::~RigidBodyPool()
+		{
+			for(size_t i = 0; i < _bodies.size(); i ++)
+			{
+				RigidBody *body = _bodies[i];
+				
+				PhysicsWorld *owner = body->GetOwner();
+				if(owner)
+					owner->RemoveCollisionObject(body);
+				
+				_nodes[i]->Release();
+				body->Release();
+			}
+		}
+		
+		RigidBodyPool::Key RigidBodyPool::GetKey(Shape *shape, float mass) const
+		{
+			// Static bodies get their own class, they can't be turned dynamic without reinsertion
+			int32 massClass = (mass > 0.0f) ? static_cast<int32>(std::lround(mass / _massGranularity)) + 1 : 0;
+			return std::make_pair(shape, massClass);
+		}
+		
+		RigidBody *RigidBodyPool::CreateBody(PhysicsWorld *world, Shape *shape, float mass)
+		{
+			SceneNode *node = new SceneNode();
+			RigidBody *body = new RigidBody(shape, mass);
+			
+			node->AddAttachment(body);
+			
+			// Attaching registers the body with the shared world
+			PhysicsWorld *owner = body->GetOwner();
+			if(owner != world)
+			{
+				if(owner)
+					owner->RemoveCollisionObject(body);
+				
+				world->InsertCollisionObject(body);
+			}
+			
+			_nodes.push_back(node);
+			_bodies.push_back(body);
+			
+			return body;
+		}
+		
+		void RigidBodyPool::Park(RigidBody *body)
+		{
+			PhysicsWorld *world = body->GetOwner();
+			btRigidBody *rigidBody = body->GetBulletRigidBody();
+			
+			if(!world)
+				return;
+			
+			LockGuard<PhysicsWorld *> lock(world);
+			
+			rigidBody->forceActivationState(DISABLE_SIMULATION);
+			rigidBody->setLinearVelocity(btVector3(0.0f, 0.0f, 0.0f));
+			rigidBody->setAngularVelocity(btVector3(0.0f, 0.0f, 0.0f));
+			rigidBody->clearForces();
+			
+			// Parked bodies keep their broadphase proxy but stop generating pairs
+			btBroadphaseProxy *proxy = rigidBody->getBroadphaseHandle();
+			if(proxy)
+			{
+				btDynamicsWorld *dynamicsWorld = world->GetBulletDynamicsWorld();
+				
+				proxy->m_collisionFilterGroup = 0;
+				proxy->m_collisionFilterMask = 0;
+				
+				dynamicsWorld->getBroadphase()->getOverlappingPairCache()->cleanProxyFromPairs(proxy, dynamicsWorld->getDispatcher());
+			}
+		}
+		
+		void RigidBodyPool::Reserve(PhysicsWorld *world, Shape *shape, float mass, size_t count)
+		{
+			std::vector<RigidBody *> &available = _available[GetKey(shape, mass)];
+			
+			available.reserve(available.size() + count);
+			_nodes.reserve(_nodes.size() + count);
+			_bodies.reserve(_bodies.size() + count);
+			
+			for(size_t i = 0; i < count; i ++)
+			{
+				RigidBody *body = CreateBody(world, shape, mass);
+				Park(body);
+				
+				available.push_back(body);
+			}
+			
+			_availableCount += count;
+		}
+		
+		RigidBody *RigidBodyPool::Acquire(PhysicsWorld *world, Shape *shape, float mass, const Vector3 &position, const Quaternion &rotation)
+		{
+			Key key = GetKey(shape, mass);
+			std::vector<RigidBody *> &available = _available[key];
+			
+			RigidBody *body;
+			
+			if(available.empty())
+			{
+				body = CreateBody(world, shape, mass);
+			}
+			else
+			{
+				body = available.back();
+				available.pop_back();
+				
+				_availableCount --;
+				
+				PhysicsWorld *owner = body->GetOwner();
+				if(owner != world)
+				{
+					if(owner)
+						owner->RemoveCollisionObject(body);
+					
+					world->InsertCollisionObject(body);
+				}
+			}
+			
+			LockGuard<PhysicsWorld *> lock(world);
+			
+			SceneNode *node = body->GetParent();
+			node->SetWorldPosition(position);
+			node->SetWorldRotation(rotation);
+			
+			btRigidBody *rigidBody = body->GetBulletRigidBody();
+			
+			if(rigidBody->getInvMass() != ((mass > 0.0f) ? 1.0f / mass : 0.0f))
+				body->SetMass(mass);
+			
+			body->ResetState();
+			
+			world->GetBulletDynamicsWorld()->updateSingleAabb(rigidBody);
+			
+			// Restores the filter and collects the pairs right away, the broadphase doesn't query a proxy whose bounds didn't move
+			world->UpdateCollisionFilter(rigidBody, body->GetCollisionFilter(), body->GetCollisionFilterMask());
+			
+			_inUse.emplace(body, key);
+			return body;
+		}
+		
+		void RigidBodyPool::Relinquish(RigidBody *body)
+		{
+			auto iterator = _inUse.find(body);
+			if(iterator == _inUse.end())
+				return;
+			
+			Park(body);
+			
+			_available[iterator->second].push_back(body);
+			_availableCount ++;
+			
+			_inUse.erase(iterator);
+		}
 	}
-}
\ No newline at end of file
+}
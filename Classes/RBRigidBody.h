@@ -45,6 +45,18 @@ namespace RN
 			void SetCCDSweptSphereRadius(float radius);
 			void SetGravity(const Vector3 &gravity);
 			void SetDamping(float linear, float angular);
+			void SetSleepingThresholds(float linear, float angular);
+			void SetAllowsSleeping(bool allowsSleeping);
+			
+			// Kinematic bodies follow their node, Bullet infers their velocity from the pose change of every step
+			void SetKinematic(bool kinematic);
+			
+			void Sleep();
+			void WakeUp();
+			
+			bool IsSleeping() const;
+			bool AllowsSleeping() const;
+			bool IsKinematic() const { return _kinematic; }
 			
 			void ApplyForce(const Vector3 &force);
 			void ApplyForce(const Vector3 &force, const Vector3 &origin);
@@ -61,6 +73,11 @@ namespace RN
 			Vector3 GetCenterOfMass() const;
 			Matrix GetCenterOfMassTransform() const;
 			
+			Shape *GetShape() const { return _shape; }
+			
+			// Clears velocities and forces and snaps the body to its node
+			void ResetState();
+			
 			btCollisionObject *GetBulletCollisionObject() override { return _rigidBody; }
 			btRigidBody *GetBulletRigidBody() { return _rigidBody; }
 			
@@ -78,8 +95,46 @@ namespace RN
 			Shape *_shape;
 			btRigidBody *_rigidBody;
 			
+			bool _kinematic;
+			float _dynamicMass;
+			Vector3 _dynamicInertia;
+			
 			RNDeclareMeta(RigidBody)
 		};
+		
+		class RigidBodyPool : public Object
+		{
+		public:
+			RigidBodyPool(float massGranularity = 0.5f);
+			~RigidBodyPool() override;
+			
+			void Reserve(PhysicsWorld *world, Shape *shape, float mass, size_t count);
+			
+			// Recycles a parked body with the same shape and mass class, or creates a new one if there is none
+			RigidBody *Acquire(PhysicsWorld *world, Shape *shape, float mass, const Vector3 &position, const Quaternion &rotation);
+			void Relinquish(RigidBody *body);
+			
+			size_t GetCount() const { return _bodies.size(); }
+			size_t GetAvailableCount() const { return _availableCount; }
+			
+		private:
+			typedef std::pair<Shape *, int32> Key;
+			
+			Key GetKey(Shape *shape, float mass) const;
+			RigidBody *CreateBody(PhysicsWorld *world, Shape *shape, float mass);
+			void Park(RigidBody *body);
+			
+			float _massGranularity;
+			size_t _availableCount;
+			
+			std::vector<SceneNode *> _nodes;
+			std::vector<RigidBody *> _bodies;
+			
+			std::map<Key, std::vector<RigidBody *>> _available;
+			std::unordered_map<RigidBody *, Key> _inUse;
+			
+			RNDeclareMeta(RigidBodyPool)
+		};
 	}
 }
 
@@ -15,6 +15,8 @@
 //  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 //
 
+#include <BulletCollision/Gimpact/btGImpactShape.h>
+#include <BulletCollision/CollisionShapes/btMultimaterialTriangleMeshShape.h>
 #include "RBShape.h"
 
 namespace RN
@@ -29,14 +31,116 @@ namespace RN
 		RNDefineMeta(CapsuleShape, Shape)
 		RNDefineMeta(StaticPlaneShape, Shape)
 		RNDefineMeta(TriangleMeshShape, Shape)
+		RNDefineMeta(GImpactMeshShape, Shape)
+		RNDefineMeta(ScaledMeshInstance, Shape)
 		RNDefineMeta(CompoundShape, Shape)
 		
+		class GImpactDeformableMeshShape : public btGImpactMeshShape
+		{
+		public:
+			GImpactDeformableMeshShape(btStridingMeshInterface *meshInterface) :
+				btGImpactMeshShape(meshInterface)
+			{}
+			
+			// The quantized tree of a part can only be refit within the bounds it was built with
+			void RebuildPart(int index)
+			{
+				btGImpactMeshShapePart *part = new btGImpactMeshShapePart(getMeshInterface(), index);
+				part->setMargin(m_mesh_parts[index]->getMargin());
+				part->setLocalScaling(localScaling);
+				
+				delete m_mesh_parts[index];
+				m_mesh_parts[index] = part;
+				
+				postUpdate();
+			}
+		};
+		
+		static void ReadIndices(Mesh *mesh, std::vector<int> &indices)
+		{
+			const MeshDescriptor *inddescriptor = mesh->GetDescriptorForFeature(MeshFeature::Indices);
+			
+			indices.reserve(indices.size() + mesh->GetIndicesCount());
+			
+			switch(inddescriptor->elementSize)
+			{
+				case 1:
+				{
+					const uint8 *index = mesh->GetIndicesData<uint8>();
+					const uint8 *end = index + mesh->GetIndicesCount();
+					
+					while(index != end)
+						indices.push_back(*index ++);
+					
+					break;
+				}
+					
+				case 2:
+				{
+					const uint16 *index = mesh->GetIndicesData<uint16>();
+					const uint16 *end = index + mesh->GetIndicesCount();
+					
+					while(index != end)
+						indices.push_back(*index ++);
+					
+					break;
+				}
+					
+				case 4:
+				{
+					const uint32 *index = mesh->GetIndicesData<uint32>();
+					const uint32 *end = index + mesh->GetIndicesCount();
+					
+					while(index != end)
+						indices.push_back(static_cast<int>(*index ++));
+					
+					break;
+				}
+			}
+		}
+		
+		class LazyBoundsCompoundShape : public btCompoundShape
+		{
+		public:
+			LazyBoundsCompoundShape(bool enableDynamicAabbTree) :
+				btCompoundShape(enableDynamicAabbTree),
+				_boundsDirty(false)
+			{}
+			
+			// Removals and transform updates only flag the local bounds, the next query recomputes them once
+			void getAabb(const btTransform &transform, btVector3 &aabbMin, btVector3 &aabbMax) const override
+			{
+				if(_boundsDirty)
+				{
+					const_cast<LazyBoundsCompoundShape *>(this)->recalculateLocalAabb();
+					_boundsDirty = false;
+				}
+				
+				btCompoundShape::getAabb(transform, aabbMin, aabbMax);
+			}
+			
+			void InvalidateBounds()
+			{
+				_boundsDirty = true;
+			}
+			
+		private:
+			mutable bool _boundsDirty;
+		};
+		
+		static btTransform MakeTransform(const Vector3 &position, const Quaternion &rotation)
+		{
+			return btTransform(btQuaternion(rotation.x, rotation.y, rotation.z, rotation.w), btVector3(position.x, position.y, position.z));
+		}
+		
 		Shape::Shape() :
-			_shape(nullptr)
+			_shape(nullptr),
+			_principalTransform(btTransform::getIdentity())
 		{}
 		
 		Shape::Shape(btCollisionShape *shape) :
-			_shape(shape)
+			_shape(shape),
+			_principalTransform(btTransform::getIdentity())
 		{}
 		
 		Shape::~Shape()
@@ -59,6 +163,104 @@ namespace RN
 			_shape->setLocalScaling(btVector3(scale.x, scale.y, scale.z));
 		}
 		
+		static size_t GetMeshInterfaceMemoryFootprint(const btStridingMeshInterface *meshInterface)
+		{
+			size_t size = 0;
+			
+			for(int i = 0; i < meshInterface->getNumSubParts(); i ++)
+			{
+				const unsigned char *vertexBase;
+				const unsigned char *indexBase;
+				int vertexCount, vertexStride;
+				int faceCount, indexStride;
+				PHY_ScalarType vertexType, indexType;
+				
+				meshInterface->getLockedReadOnlyVertexIndexBase(&vertexBase, vertexCount, vertexType, vertexStride, &indexBase, indexStride, faceCount, indexType, i);
+				meshInterface->unLockReadOnlyVertexBase(i);
+				
+				size += static_cast<size_t>(vertexCount) * vertexStride + static_cast<size_t>(faceCount) * indexStride;
+			}
+			
+			return size;
+		}
+		
+		size_t Shape::GetMemoryFootprint() const
+		{
+			return sizeof(*this) + GetBulletMemoryFootprint(_shape);
+		}
+		
+		size_t Shape::GetBulletMemoryFootprint(const btCollisionShape *shape)
+		{
+			if(!shape)
+				return 0;
+			
+			switch(shape->getShapeType())
+			{
+				case SPHERE_SHAPE_PROXYTYPE:
+					return sizeof(btSphereShape);
+				case BOX_SHAPE_PROXYTYPE:
+					return sizeof(btBoxShape);
+				case CYLINDER_SHAPE_PROXYTYPE:
+					return sizeof(btCylinderShape);
+				case CAPSULE_SHAPE_PROXYTYPE:
+					return sizeof(btCapsuleShape);
+				case STATIC_PLANE_PROXYTYPE:
+					return sizeof(btStaticPlaneShape);
+					
+				case MULTI_SPHERE_SHAPE_PROXYTYPE:
+				{
+					const btMultiSphereShape *multiSphere = static_cast<const btMultiSphereShape *>(shape);
+					return sizeof(btMultiSphereShape) + multiSphere->getSphereCount() * (sizeof(btVector3) + sizeof(btScalar));
+				}
+					
+				case CONVEX_HULL_SHAPE_PROXYTYPE:
+				{
+					const btConvexHullShape *hull = static_cast<const btConvexHullShape *>(shape);
+					return sizeof(btConvexHullShape) + hull->getNumPoints() * sizeof(btVector3);
+				}
+					
+				case TRIANGLE_MESH_SHAPE_PROXYTYPE:
+				case MULTIMATERIAL_TRIANGLE_MESH_PROXYTYPE:
+				{
+					btBvhTriangleMeshShape *mesh = static_cast<btBvhTriangleMeshShape *>(const_cast<btCollisionShape *>(shape));
+					size_t size = sizeof(btMultimaterialTriangleMeshShape) + GetMeshInterfaceMemoryFootprint(mesh->getMeshInterface());
+					
+					if(mesh->getOptimizedBvh())
+						size += mesh->getOptimizedBvh()->calculateSerializeBufferSize();
+					
+					return size;
+				}
+					
+				case SCALED_TRIANGLE_MESH_SHAPE_PROXYTYPE:
+					return sizeof(btScaledBvhTriangleMeshShape);
+					
+				case GIMPACT_SHAPE_PROXYTYPE:
+				{
+					const btGImpactMeshShape *mesh = static_cast<const btGImpactMeshShape *>(shape);
+					size_t size = sizeof(btGImpactMeshShape) + GetMeshInterfaceMemoryFootprint(mesh->getMeshInterface());
+					
+					for(int i = 0; i < mesh->getMeshPartCount(); i ++)
+						size += sizeof(btGImpactMeshShapePart) + mesh->getMeshPart(i)->getBoxSet()->getNodeCount() * sizeof(BT_QUANTIZED_BVH_NODE);
+					
+					return size;
+				}
+					
+				case COMPOUND_SHAPE_PROXYTYPE:
+				{
+					const btCompoundShape *compound = static_cast<const btCompoundShape *>(shape);
+					size_t size = sizeof(btCompoundShape) + compound->getNumChildShapes() * sizeof(btCompoundShapeChild);
+					
+					if(compound->getDynamicAabbTree())
+						size += std::max(compound->getDynamicAabbTree()->m_leaves * 2 - 1, 0) * sizeof(btDbvtNode);
+					
+					return size;
+				}
+					
+				default:
+					return shape->isConcave() ? sizeof(btConcaveShape) : sizeof(btConvexInternalShape);
+			}
+		}
+		
 		
 		
 		SphereShape::SphereShape(float radius)
@@ -142,7 +344,8 @@ namespace RN
 		}
 		
 		
-		TriangleMeshShape::TriangleMeshShape(Model *model)
+		TriangleMeshShape::TriangleMeshShape(Model *model) :
+			_materialMesh(nullptr)
 		{
 			_triangleMesh = new btTriangleMesh();
 			
@@ -156,7 +359,8 @@ namespace RN
 			_shape = new btBvhTriangleMeshShape(_triangleMesh, true);
 		}
 		
-		TriangleMeshShape::TriangleMeshShape(Mesh *mesh)
+		TriangleMeshShape::TriangleMeshShape(Mesh *mesh) :
+			_materialMesh(nullptr)
 		{
 			_triangleMesh = new btTriangleMesh();
 			
@@ -165,7 +369,8 @@ namespace RN
 			_shape = new btBvhTriangleMeshShape(_triangleMesh, true);
 		}
 		
-		TriangleMeshShape::TriangleMeshShape(const Array *meshes)
+		TriangleMeshShape::TriangleMeshShape(const Array *meshes) :
+			_materialMesh(nullptr)
 		{
 			_triangleMesh = new btTriangleMesh();
 			
@@ -178,9 +383,67 @@ namespace RN
 			_shape = new btBvhTriangleMeshShape(_triangleMesh, true);
 		}
 		
+		TriangleMeshShape::TriangleMeshShape(const Array *meshes, const Array *materials) :
+			_triangleMesh(nullptr)
+		{
+			materials->Enumerate<PhysicsMaterial>([&](PhysicsMaterial *material, size_t index, bool &stop) {
+				
+				_materials.push_back(material->Retain());
+				_connections.push_back(material->signal.Connect(std::bind(&TriangleMeshShape::UpdateMaterial, this, index)));
+				
+			});
+			
+			_materialTable.resize(std::max<size_t>(_materials.size(), 1), btMaterial(0.5f, 0.0f));
+			
+			for(size_t i = 0; i < _materials.size(); i ++)
+				UpdateMaterial(i);
+			
+			meshes->Enumerate<Mesh>([&](Mesh *mesh, size_t index, bool &stop) {
+				
+				AddMaterialMesh(mesh, static_cast<int>(std::min(index, _materialTable.size() - 1)));
+				
+			});
+			
+			// The part vectors are final at this point, the interface only references their storage
+			_materialMesh = new btTriangleIndexVertexMaterialArray();
+			
+			for(MaterialPart &part : _parts)
+			{
+				btIndexedMesh indexedMesh;
+				indexedMesh.m_numTriangles = static_cast<int>(part.indices.size() / 3);
+				indexedMesh.m_triangleIndexBase = reinterpret_cast<const unsigned char *>(part.indices.data());
+				indexedMesh.m_triangleIndexStride = 3 * sizeof(int);
+				indexedMesh.m_numVertices = static_cast<int>(part.vertices.size() / 3);
+				indexedMesh.m_vertexBase = reinterpret_cast<const unsigned char *>(part.vertices.data());
+				indexedMesh.m_vertexStride = 3 * sizeof(float);
+				
+				_materialMesh->addIndexedMesh(indexedMesh, PHY_INTEGER);
+				
+				btMaterialProperties properties;
+				properties.m_numMaterials = static_cast<int>(_materialTable.size());
+				properties.m_materialBase = reinterpret_cast<const unsigned char *>(_materialTable.data());
+				properties.m_materialStride = sizeof(btMaterial);
+				properties.m_materialType = PHY_FLOAT;
+				properties.m_numTriangles = indexedMesh.m_numTriangles;
+				properties.m_triangleMaterialsBase = reinterpret_cast<const unsigned char *>(part.materials.data());
+				properties.m_triangleMaterialStride = sizeof(int);
+				
+				_materialMesh->addMaterialProperties(properties, PHY_INTEGER);
+			}
+			
+			_shape = new btMultimaterialTriangleMeshShape(_materialMesh, true);
+		}
+		
 		TriangleMeshShape::~TriangleMeshShape()
 		{
+			for(Connection *connection : _connections)
+				connection->Disconnect();
+			
+			for(PhysicsMaterial *material : _materials)
+				material->Release();
+			
 			delete _triangleMesh;
+			delete _materialMesh;
 		}
 		
 		TriangleMeshShape *TriangleMeshShape::WithModel(Model *model)
@@ -189,6 +452,73 @@ namespace RN
 			return shape->Autorelease();
 		}
 		
+		TriangleMeshShape *TriangleMeshShape::WithMeshes(const Array *meshes, const Array *materials)
+		{
+			TriangleMeshShape *shape = new TriangleMeshShape(meshes, materials);
+			return shape->Autorelease();
+		}
+		
+		void TriangleMeshShape::SetTriangleMaterial(size_t part, size_t triangle, size_t material)
+		{
+			if(!_materialMesh || material >= _materialTable.size())
+				return;
+			
+			if(part >= _parts.size() || triangle >= _parts[part].materials.size())
+				return;
+			
+			_parts[part].materials[triangle] = static_cast<int>(material);
+		}
+		
+		size_t TriangleMeshShape::GetTriangleMaterial(size_t part, size_t triangle) const
+		{
+			if(!_materialMesh || part >= _parts.size() || triangle >= _parts[part].materials.size())
+				return 0;
+			
+			return static_cast<size_t>(_parts[part].materials[triangle]);
+		}
+		
+		size_t TriangleMeshShape::GetMemoryFootprint() const
+		{
+			size_t size = Shape::GetMemoryFootprint() + _materialTable.capacity() * sizeof(btMaterial) + _materials.capacity() * sizeof(PhysicsMaterial *);
+			
+			for(const MaterialPart &part : _parts)
+				size += part.materials.capacity() * sizeof(int);
+			
+			return size;
+		}
+		
+		void TriangleMeshShape::UpdateMaterial(size_t index)
+		{
+			_materialTable[index].m_friction = _materials[index]->GetFriction();
+			_materialTable[index].m_restitution = _materials[index]->GetRestitution();
+		}
+		
+		void TriangleMeshShape::AddMaterialMesh(Mesh *mesh, int material)
+		{
+			const MeshDescriptor *posdescriptor = mesh->GetDescriptorForFeature(MeshFeature::Vertices);
+			const uint8 *pospointer = mesh->GetVerticesData<uint8>() + posdescriptor->offset;
+			
+			size_t stride = mesh->GetStride();
+			size_t count = mesh->GetVerticesCount();
+			
+			MaterialPart part;
+			part.vertices.reserve(count * 3);
+			
+			for(size_t i = 0; i < count; i ++)
+			{
+				const Vector3 *vertex = reinterpret_cast<const Vector3 *>(pospointer + stride * i);
+				
+				part.vertices.push_back(vertex->x);
+				part.vertices.push_back(vertex->y);
+				part.vertices.push_back(vertex->z);
+			}
+			
+			ReadIndices(mesh, part.indices);
+			part.materials.resize(part.indices.size() / 3, material);
+			
+			_parts.push_back(std::move(part));
+		}
+		
 		Vector3 TriangleMeshShape::CalculateLocalInertia(float mass)
 		{
 			return Vector3(0.0f, 0.0f, 0.0f);
@@ -262,9 +592,246 @@ namespace RN
 			}
 		}
 		
-		CompoundShape::CompoundShape()
+		GImpactMeshShape::GImpactMeshShape(Model *model) :
+			_meshInterface(nullptr)
+		{
+			size_t meshes = model->GetMeshCount(0);
+			for(size_t i=0; i<meshes; i++)
+			{
+				Mesh *mesh = model->GetMeshAtIndex(0, i);
+				AddMesh(mesh);
+			}
+			
+			CreateShape();
+		}
+		
+		GImpactMeshShape::GImpactMeshShape(Mesh *mesh) :
+			_meshInterface(nullptr)
+		{
+			AddMesh(mesh);
+			CreateShape();
+		}
+		
+		GImpactMeshShape::GImpactMeshShape(const Array *meshes) :
+			_meshInterface(nullptr)
+		{
+			meshes->Enumerate<Mesh>([&](Mesh *mesh, size_t index, bool &stop) {
+				
+				AddMesh(mesh);
+				
+			});
+			
+			CreateShape();
+		}
+		
+		GImpactMeshShape::~GImpactMeshShape()
+		{
+			delete _shape;
+			_shape = nullptr;
+			
+			delete _meshInterface;
+		}
+		
+		GImpactMeshShape *GImpactMeshShape::WithModel(Model *model)
+		{
+			GImpactMeshShape *shape = new GImpactMeshShape(model);
+			return shape->Autorelease();
+		}
+		
+		void GImpactMeshShape::ReadVertices(Mesh *mesh, float *vertices)
+		{
+			const MeshDescriptor *posdescriptor = mesh->GetDescriptorForFeature(MeshFeature::Vertices);
+			const uint8 *pospointer = mesh->GetVerticesData<uint8>() + posdescriptor->offset;
+			
+			size_t stride = mesh->GetStride();
+			size_t count = mesh->GetVerticesCount();
+			
+			for(size_t i = 0; i < count; i ++)
+			{
+				const Vector3 *vertex = reinterpret_cast<const Vector3 *>(pospointer + stride * i);
+				
+				*vertices ++ = vertex->x;
+				*vertices ++ = vertex->y;
+				*vertices ++ = vertex->z;
+			}
+		}
+		
+		void GImpactMeshShape::AddMesh(Mesh *mesh)
+		{
+			Part part;
+			part.vertices.resize(mesh->GetVerticesCount() * 3);
+			
+			ReadVertices(mesh, part.vertices.data());
+			ReadIndices(mesh, part.indices);
+			
+			_parts.push_back(std::move(part));
+		}
+		
+		void GImpactMeshShape::CreateShape()
+		{
+			_meshInterface = new btTriangleIndexVertexArray();
+			
+			for(Part &part : _parts)
+			{
+				btIndexedMesh indexedMesh;
+				indexedMesh.m_numTriangles = static_cast<int>(part.indices.size() / 3);
+				indexedMesh.m_triangleIndexBase = reinterpret_cast<const unsigned char *>(part.indices.data());
+				indexedMesh.m_triangleIndexStride = 3 * sizeof(int);
+				indexedMesh.m_numVertices = static_cast<int>(part.vertices.size() / 3);
+				indexedMesh.m_vertexBase = reinterpret_cast<const unsigned char *>(part.vertices.data());
+				indexedMesh.m_vertexStride = 3 * sizeof(float);
+				
+				_meshInterface->addIndexedMesh(indexedMesh, PHY_INTEGER);
+				
+				part.buildMin = Vector3(BT_LARGE_FLOAT, BT_LARGE_FLOAT, BT_LARGE_FLOAT);
+				part.buildMax = Vector3(-BT_LARGE_FLOAT, -BT_LARGE_FLOAT, -BT_LARGE_FLOAT);
+				
+				for(size_t i = 0; i < part.vertices.size(); i += 3)
+				{
+					part.buildMin = Vector3(std::min(part.buildMin.x, part.vertices[i]), std::min(part.buildMin.y, part.vertices[i + 1]), std::min(part.buildMin.z, part.vertices[i + 2]));
+					part.buildMax = Vector3(std::max(part.buildMax.x, part.vertices[i]), std::max(part.buildMax.y, part.vertices[i + 1]), std::max(part.buildMax.z, part.vertices[i + 2]));
+				}
+			}
+			
+			GImpactDeformableMeshShape *shape = new GImpactDeformableMeshShape(_meshInterface);
+			shape->updateBound();
+			
+			_shape = shape;
+		}
+		
+		void GImpactMeshShape::UpdateVertices(size_t index, const Vector3 *vertices)
+		{
+			if(index >= _parts.size())
+				return;
+			
+			Part &part = _parts[index];
+			
+			Vector3 min(BT_LARGE_FLOAT, BT_LARGE_FLOAT, BT_LARGE_FLOAT);
+			Vector3 max(-BT_LARGE_FLOAT, -BT_LARGE_FLOAT, -BT_LARGE_FLOAT);
+			
+			float *data = part.vertices.data();
+			size_t count = part.vertices.size() / 3;
+			
+			for(size_t i = 0; i < count; i ++)
+			{
+				const Vector3 &vertex = vertices[i];
+				
+				*data ++ = vertex.x;
+				*data ++ = vertex.y;
+				*data ++ = vertex.z;
+				
+				min = Vector3(std::min(min.x, vertex.x), std::min(min.y, vertex.y), std::min(min.z, vertex.z));
+				max = Vector3(std::max(max.x, vertex.x), std::max(max.y, vertex.y), std::max(max.z, vertex.z));
+			}
+			
+			UpdatePart(index, min, max);
+		}
+		
+		void GImpactMeshShape::UpdateVertices(size_t index, Mesh *mesh)
+		{
+			if(index >= _parts.size())
+				return;
+			
+			Part &part = _parts[index];
+			
+			// The part's buffer and index data were built for a fixed vertex count
+			if(mesh->GetVerticesCount() * 3 != part.vertices.size())
+				return;
+			
+			ReadVertices(mesh, part.vertices.data());
+			
+			Vector3 min(BT_LARGE_FLOAT, BT_LARGE_FLOAT, BT_LARGE_FLOAT);
+			Vector3 max(-BT_LARGE_FLOAT, -BT_LARGE_FLOAT, -BT_LARGE_FLOAT);
+			
+			for(size_t i = 0; i < part.vertices.size(); i += 3)
+			{
+				min = Vector3(std::min(min.x, part.vertices[i]), std::min(min.y, part.vertices[i + 1]), std::min(min.z, part.vertices[i + 2]));
+				max = Vector3(std::max(max.x, part.vertices[i]), std::max(max.y, part.vertices[i + 1]), std::max(max.z, part.vertices[i + 2]));
+			}
+			
+			UpdatePart(index, min, max);
+		}
+		
+		void GImpactMeshShape::UpdatePart(size_t index, const Vector3 &min, const Vector3 &max)
+		{
+			GImpactDeformableMeshShape *shape = static_cast<GImpactDeformableMeshShape *>(_shape);
+			Part &part = _parts[index];
+			
+			const float tolerance = 0.5f;
+			
+			bool escaped = (min.x < part.buildMin.x - tolerance || min.y < part.buildMin.y - tolerance || min.z < part.buildMin.z - tolerance ||
+							max.x > part.buildMax.x + tolerance || max.y > part.buildMax.y + tolerance || max.z > part.buildMax.z + tolerance);
+			
+			if(escaped)
+			{
+				shape->RebuildPart(static_cast<int>(index));
+				
+				part.buildMin = min;
+				part.buildMax = max;
+			}
+			else
+			{
+				shape->getMeshPart(static_cast<int>(index))->postUpdate();
+				shape->postUpdate();
+			}
+			
+			// Only parts flagged by postUpdate() refit their tree, the others just contribute their cached bounds
+			shape->updateBound();
+		}
+		
+		
+		
+		ScaledMeshInstance::ScaledMeshInstance(TriangleMeshShape *mesh, const Vector3 &scale) :
+			_mesh(mesh->Retain())
+		{
+			btBvhTriangleMeshShape *shape = static_cast<btBvhTriangleMeshShape *>(_mesh->GetBulletShape());
+			_shape = new btScaledBvhTriangleMeshShape(shape, btVector3(scale.x, scale.y, scale.z));
+		}
+		
+		ScaledMeshInstance::~ScaledMeshInstance()
 		{
-			_shape = new btCompoundShape();
+			_mesh->Release();
+		}
+		
+		ScaledMeshInstance *ScaledMeshInstance::WithMesh(TriangleMeshShape *mesh, const Vector3 &scale)
+		{
+			ScaledMeshInstance *shape = new ScaledMeshInstance(mesh, scale);
+			return shape->Autorelease();
+		}
+		
+		Vector3 ScaledMeshInstance::CalculateLocalInertia(float mass)
+		{
+			return Vector3(0.0f, 0.0f, 0.0f);
+		}
+		
+		
+		
+		CompoundShape::CompoundShape() :
+			_hasPrincipalInertia(false)
+		{
+			_shape = new LazyBoundsCompoundShape(true);
+		}
+		
+		CompoundShape::CompoundShape(const std::vector<Child> &children) :
+			_hasPrincipalInertia(false)
+		{
+			// Children go in without tree updates, the tree is built once from all of them
+			LazyBoundsCompoundShape *compoundShape = new LazyBoundsCompoundShape(false);
+			_shape = compoundShape;
+			
+			_shapes.reserve(children.size());
+			_masses.reserve(children.size());
+			
+			for(const Child &child : children)
+			{
+				_shapes.push_back(child.shape->Retain());
+				_masses.push_back(child.mass);
+				
+				compoundShape->addChildShape(MakeTransform(child.position, child.rotation), child.shape->GetBulletShape());
+			}
+			
+			compoundShape->createAabbTreeFromChildren();
+			compoundShape->getDynamicAabbTree()->optimizeTopDown();
 		}
 		
 		CompoundShape::~CompoundShape()
@@ -275,16 +842,99 @@ namespace RN
 			}
 		}
 		
-		void CompoundShape::AddChild(Shape *shape, const RN::Vector3 &position, const RN::Quaternion &rotation)
+		CompoundShape *CompoundShape::WithChildren(const std::vector<Child> &children)
+		{
+			CompoundShape *shape = new CompoundShape(children);
+			return shape->Autorelease();
+		}
+		
+		void CompoundShape::AddChild(Shape *shape, const RN::Vector3 &position, const RN::Quaternion &rotation, float mass)
 		{
 			btCompoundShape *compoundShape = static_cast<btCompoundShape *>(_shape);
 			
 			_shapes.push_back(shape->Retain());
+			_masses.push_back(mass);
+			
+			compoundShape->addChildShape(_principalTransform.inverse() * MakeTransform(position, rotation), shape->GetBulletShape());
+			
+			// The cached inertia belongs to the old child set, CalculatePrincipalAxis() has to run again
+			_hasPrincipalInertia = false;
+		}
+		
+		void CompoundShape::RemoveChild(size_t index)
+		{
+			LazyBoundsCompoundShape *compoundShape = static_cast<LazyBoundsCompoundShape *>(_shape);
+			
+			if(index >= _shapes.size())
+				return;
+			
+			compoundShape->removeChildShapeByIndex(static_cast<int>(index));
+			compoundShape->InvalidateBounds();
+			
+			// Mirrors Bullet, which swaps the last child into the freed slot
+			_shapes[index]->Release();
+			
+			_shapes[index] = _shapes.back();
+			_masses[index] = _masses.back();
+			
+			_shapes.pop_back();
+			_masses.pop_back();
+			
+			_hasPrincipalInertia = false;
+		}
+		
+		void CompoundShape::UpdateChildTransform(size_t index, const Vector3 &position, const Quaternion &rotation)
+		{
+			LazyBoundsCompoundShape *compoundShape = static_cast<LazyBoundsCompoundShape *>(_shape);
 			
-			btTransform transform;
-			transform.setRotation(btQuaternion(rotation.x, rotation.y, rotation.z, rotation.w));
-			transform.setOrigin(btVector3(position.x, position.y, position.z));
-			compoundShape->addChildShape(transform, shape->GetBulletShape());
+			if(index >= _shapes.size())
+				return;
+			
+			compoundShape->updateChildTransform(static_cast<int>(index), _principalTransform.inverse() * MakeTransform(position, rotation), false);
+			compoundShape->InvalidateBounds();
+			
+			_hasPrincipalInertia = false;
+		}
+		
+		void CompoundShape::CalculatePrincipalAxis()
+		{
+			LazyBoundsCompoundShape *compoundShape = static_cast<LazyBoundsCompoundShape *>(_shape);
+			
+			if(_shapes.empty())
+				return;
+			
+			float totalMass = 0.0f;
+			for(float mass : _masses)
+				totalMass += mass;
+			
+			// Bullet divides by the total mass, massless compounds keep their frame
+			if(totalMass <= 0.0f)
+				return;
+			
+			btTransform principal;
+			btVector3 inertia;
+			
+			compoundShape->calculatePrincipalAxisTransform(_masses.data(), principal, inertia);
+			
+			btTransform inverse = principal.inverse();
+			
+			for(int i = 0; i < compoundShape->getNumChildShapes(); i ++)
+				compoundShape->updateChildTransform(i, inverse * compoundShape->getChildTransform(i), false);
+			
+			compoundShape->InvalidateBounds();
+			
+			_principalTransform = _principalTransform * principal;
+			_principalInertia = inertia / totalMass;
+			_hasPrincipalInertia = true;
+		}
+		
+		Vector3 CompoundShape::CalculateLocalInertia(float mass)
+		{
+			if(!_hasPrincipalInertia)
+				return Shape::CalculateLocalInertia(mass);
+			
+			btVector3 inertia = _principalInertia * mass;
+			return Vector3(inertia.x(), inertia.y(), inertia.z());
 		}
 	}
 }
@@ -20,6 +20,9 @@
 
 #include <Rayne/Rayne.h>
 #include <btBulletDynamicsCommon.h>
+#include <BulletCollision/CollisionShapes/btTriangleIndexVertexMaterialArray.h>
+#include <BulletCollision/CollisionShapes/btMaterial.h>
+#include "RBPhysicsMaterial.h"
 
 namespace RN
 {
@@ -35,11 +38,19 @@ namespace RN
 			
 			btCollisionShape *GetBulletShape() const { return _shape; }
 			
+			// Center of mass and inertia axes relative to the shape's origin, rigid bodies simulate in this frame
+			const btTransform &GetPrincipalTransform() const { return _principalTransform; }
+			
+			// Estimated bytes of the shape including mesh data and bounding volume hierarchies, shared child shapes excluded
+			virtual size_t GetMemoryFootprint() const;
+			static size_t GetBulletMemoryFootprint(const btCollisionShape *shape);
+			
 		protected:
 			Shape();
 			~Shape() override;
 			
 			btCollisionShape *_shape;
+			btTransform _principalTransform;
 			
 			RNDeclareMeta(Shape)
 		};
@@ -115,24 +126,150 @@ namespace RN
 			
 			Vector3 CalculateLocalInertia(float mass) override;
 			
+			// Every mesh is a submesh using the material at the same index, friction and restitution are resolved per triangle
+			TriangleMeshShape(const Array *meshes, const Array *materials);
+			
 			static TriangleMeshShape *WithModel(Model *model);
+			static TriangleMeshShape *WithMeshes(const Array *meshes, const Array *materials);
+			
+			void SetTriangleMaterial(size_t part, size_t triangle, size_t material);
+			size_t GetTriangleMaterial(size_t part, size_t triangle) const;
+			
+			size_t GetMaterialCount() const { return _materials.size(); }
+			PhysicsMaterial *GetMaterial(size_t index) const { return _materials[index]; }
+			
+			size_t GetMemoryFootprint() const override;
 			
 		private:
+			struct MaterialPart
+			{
+				std::vector<float> vertices;
+				std::vector<int> indices;
+				std::vector<int> materials;
+			};
+			
 			void AddMesh(Mesh *mesh);
+			void AddMaterialMesh(Mesh *mesh, int material);
+			void UpdateMaterial(size_t index);
+			
 			btTriangleMesh *_triangleMesh;
+			btTriangleIndexVertexMaterialArray *_materialMesh;
+			
+			std::vector<MaterialPart> _parts;
+			std::vector<btMaterial> _materialTable;
+			std::vector<PhysicsMaterial *> _materials;
+			std::vector<Connection *> _connections;
 			
 			RNDeclareMeta(TriangleMeshShape)
 		};
 		
+		class GImpactMeshShape : public Shape
+		{
+		public:
+			GImpactMeshShape(Model *model);
+			GImpactMeshShape(Mesh *mesh);
+			GImpactMeshShape(const Array *meshes);
+			
+			~GImpactMeshShape() override;
+			
+			static GImpactMeshShape *WithModel(Model *model);
+			
+			// Each mesh becomes one part, updating a part only refits the bounding volume hierarchy of that part
+			// The new vertices have to match the part in count, meshes with a different vertex count are ignored
+			void UpdateVertices(size_t part, const Vector3 *vertices);
+			void UpdateVertices(size_t part, Mesh *mesh);
+			
+			size_t GetPartCount() const { return _parts.size(); }
+			size_t GetVertexCount(size_t part) const { return _parts[part].vertices.size() / 3; }
+			
+		private:
+			struct Part
+			{
+				std::vector<float> vertices;
+				std::vector<int> indices;
+				
+				Vector3 buildMin;
+				Vector3 buildMax;
+			};
+			
+			void AddMesh(Mesh *mesh);
+			void CreateShape();
+			void ReadVertices(Mesh *mesh, float *vertices);
+			void UpdatePart(size_t index, const Vector3 &min, const Vector3 &max);
+			
+			std::vector<Part> _parts;
+			btTriangleIndexVertexArray *_meshInterface;
+			
+			RNDeclareMeta(GImpactMeshShape)
+		};
+		
+		// Instances share the bounding volume hierarchy of the mesh, SetScale only changes the instance
+		class ScaledMeshInstance : public Shape
+		{
+		public:
+			ScaledMeshInstance(TriangleMeshShape *mesh, const Vector3 &scale);
+			~ScaledMeshInstance() override;
+			
+			Vector3 CalculateLocalInertia(float mass) override;
+			
+			static ScaledMeshInstance *WithMesh(TriangleMeshShape *mesh, const Vector3 &scale);
+			
+			TriangleMeshShape *GetMesh() const { return _mesh; }
+			
+		private:
+			TriangleMeshShape *_mesh;
+			
+			RNDeclareMeta(ScaledMeshInstance)
+		};
+		
 		class CompoundShape : public Shape
 		{
 		public:
+			struct Child
+			{
+				Child() :
+					shape(nullptr),
+					mass(1.0f)
+				{}
+				Child(Shape *tshape, const Vector3 &tposition, const Quaternion &trotation, float tmass = 1.0f) :
+					shape(tshape),
+					position(tposition),
+					rotation(trotation),
+					mass(tmass)
+				{}
+				
+				Shape *shape;
+				Vector3 position;
+				Quaternion rotation;
+				float mass;
+			};
+			
 			CompoundShape();
+			CompoundShape(const std::vector<Child> &children);
 			~CompoundShape();
-			void AddChild(Shape *shape, const RN::Vector3 &position, const RN::Quaternion &rotation);
+			
+			static CompoundShape *WithChildren(const std::vector<Child> &children);
+			
+			void AddChild(Shape *shape, const RN::Vector3 &position, const RN::Quaternion &rotation, float mass = 1.0f);
+			
+			// The last child takes over the index of the removed one
+			void RemoveChild(size_t index);
+			void UpdateChildTransform(size_t index, const Vector3 &position, const Quaternion &rotation);
+			
+			size_t GetChildCount() const { return _shapes.size(); }
+			Shape *GetChild(size_t index) const { return _shapes[index]; }
+			
+			// Moves the children into the frame of their combined center of mass and inertia axes, call before creating bodies
+			void CalculatePrincipalAxis();
+			
+			Vector3 CalculateLocalInertia(float mass) override;
 			
 		private:
 			std::vector<Shape *> _shapes;
+			std::vector<float> _masses;
+			
+			bool _hasPrincipalInertia;
+			btVector3 _principalInertia;
 			
 			RNDeclareMeta(CompoundShape)
 		};
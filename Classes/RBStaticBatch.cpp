@@ -0,0 +1,212 @@
+//
+//  RBStaticBatch.cpp
+//  rayne-bullet
+//
+//  Copyright 2013 by Überpixel. All rights reserved.
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "RBStaticBatch.h"
+#include "RBPhysicsWorld.h"
+
+namespace RN
+{
+	namespace bullet
+	{
+		RNDefineMeta(StaticBatch, RigidBody)
+		
+		class StaticBatchTriangleCallback : public btTriangleCallback
+		{
+		public:
+			StaticBatchTriangleCallback(btTriangleMesh *mesh, const btTransform &transform) :
+				_mesh(mesh),
+				_transform(transform)
+			{}
+			
+			void processTriangle(btVector3 *triangle, int partId, int triangleIndex) override
+			{
+				_mesh->addTriangle(_transform(triangle[0]), _transform(triangle[1]), _transform(triangle[2]), false);
+			}
+			
+		private:
+			btTriangleMesh *_mesh;
+			btTransform _transform;
+		};
+		
+		static bool IsMergeableMesh(btCollisionShape *shape)
+		{
+			return shape->isConcave();
+		}
+		
+		static bool HasTriangleMaterials(btCollisionShape *shape)
+		{
+			if(shape->getShapeType() == SCALED_TRIANGLE_MESH_SHAPE_PROXYTYPE)
+				shape = static_cast<btScaledBvhTriangleMeshShape *>(shape)->getChildShape();
+			
+			return (shape->getShapeType() == MULTIMATERIAL_TRIANGLE_MESH_PROXYTYPE);
+		}
+		
+		static bool CanBatch(RigidBody *body, RigidBody *reference)
+		{
+			btCollisionShape *shape = body->GetShape()->GetBulletShape();
+			
+			// Planes are infinite and report triangle hits that couldn't be told apart from the merged mesh
+			if(shape->getShapeType() == STATIC_PLANE_PROXYTYPE)
+				return false;
+			
+			if(body->HasContactCallback() || HasTriangleMaterials(shape))
+				return false;
+			
+			if(!reference)
+				return true;
+			
+			return (body->GetMaterial() == reference->GetMaterial() && body->GetCollisionLayer() == reference->GetCollisionLayer() &&
+					body->GetCollisionFilter() == reference->GetCollisionFilter() && body->GetCollisionFilterMask() == reference->GetCollisionFilterMask());
+		}
+		
+		StaticBatch::StaticBatch(const std::vector<RigidBody *> &bodies) :
+			RigidBody((new CompoundShape())->Autorelease(), 0.0f),
+			_mesh(nullptr),
+			_meshTriangles(0)
+		{
+			CompoundShape *compound = static_cast<CompoundShape *>(GetShape());
+			
+			for(RigidBody *body : bodies)
+			{
+				btRigidBody *rigidBody = body->GetBulletRigidBody();
+				
+				if(rigidBody->getInvMass() > 0.0f || body->IsKinematic())
+					continue;
+				
+				if(!CanBatch(body, _bodies.empty() ? nullptr : _bodies.front()))
+					continue;
+				
+				_bodies.push_back(body->Retain());
+				
+				const btTransform &transform = rigidBody->getWorldTransform();
+				
+				if(IsMergeableMesh(body->GetShape()->GetBulletShape()))
+				{
+					MergeMesh(body, transform);
+					continue;
+				}
+				
+				const btVector3 &origin = transform.getOrigin();
+				btQuaternion rotation = transform.getRotation();
+				
+				compound->AddChild(body->GetShape(), Vector3(origin.x(), origin.y(), origin.z()), Quaternion(rotation.x(), rotation.y(), rotation.z(), rotation.w()));
+				_children.push_back(body);
+			}
+			
+			if(!_bodies.empty())
+			{
+				RigidBody *reference = _bodies.front();
+				
+				SetCollisionFilter(reference->GetCollisionFilter());
+				SetCollisionFilterMask(reference->GetCollisionFilterMask());
+				SetCollisionLayer(reference->GetCollisionLayer());
+				SetMaterial(reference->GetMaterial());
+			}
+			
+			if(_mesh)
+			{
+				Shape *shape = new Shape(new btBvhTriangleMeshShape(_mesh, true));
+				
+				compound->AddChild(shape, Vector3(0.0f, 0.0f, 0.0f), Quaternion(0.0f, 0.0f, 0.0f, 1.0f));
+				_children.push_back(nullptr);
+				
+				shape->Release();
+			}
+		}
+		
+		StaticBatch::~StaticBatch()
+		{
+			for(RigidBody *body : _bodies)
+				body->Release();
+			
+			delete _mesh;
+		}
+		
+		StaticBatch *StaticBatch::WithBodies(const std::vector<RigidBody *> &bodies)
+		{
+			StaticBatch *batch = new StaticBatch(bodies);
+			return batch->Autorelease();
+		}
+		
+		
+		void StaticBatch::MergeMesh(RigidBody *body, const btTransform &transform)
+		{
+			if(!_mesh)
+				_mesh = new btTriangleMesh();
+			
+			_meshRanges.emplace_back(_mesh->getNumTriangles(), body);
+			
+			StaticBatchTriangleCallback callback(_mesh, transform);
+			
+			btVector3 aabbMin(-BT_LARGE_FLOAT, -BT_LARGE_FLOAT, -BT_LARGE_FLOAT);
+			btVector3 aabbMax(BT_LARGE_FLOAT, BT_LARGE_FLOAT, BT_LARGE_FLOAT);
+			
+			static_cast<btConcaveShape *>(body->GetShape()->GetBulletShape())->processAllTriangles(&callback, aabbMin, aabbMax);
+			
+			_meshTriangles = static_cast<size_t>(_mesh->getNumTriangles());
+		}
+		
+		SceneNode *StaticBatch::GetHitNode(int part, int index) const
+		{
+			// Convex children report their child index without a part, the merged mesh its triangle
+			if(part < 0)
+			{
+				if(index >= 0 && index < static_cast<int>(_children.size()) && _children[index])
+					return _children[index]->GetParent();
+				
+				return GetParent();
+			}
+			
+			auto iterator = std::upper_bound(_meshRanges.begin(), _meshRanges.end(), index, [](int value, const std::pair<int, RigidBody *> &range) {
+				return (value < range.first);
+			});
+			
+			if(iterator == _meshRanges.begin())
+				return GetParent();
+			
+			return (iterator - 1)->second->GetParent();
+		}
+		
+		
+		void StaticBatch::InsertIntoWorld(PhysicsWorld *world)
+		{
+			std::vector<CollisionObject *> bodies(_bodies.begin(), _bodies.end());
+			world->RemoveCollisionObjects(bodies);
+			
+			RigidBody::InsertIntoWorld(world);
+		}
+		
+		void StaticBatch::RemoveFromWorld(PhysicsWorld *world)
+		{
+			RigidBody::RemoveFromWorld(world);
+			
+			// Originals that were detached or moved to another scene in the meantime don't come back
+			std::vector<CollisionObject *> bodies;
+			bodies.reserve(_bodies.size());
+			
+			for(RigidBody *body : _bodies)
+			{
+				SceneNode *parent = body->GetParent();
+				
+				if(parent && parent->GetWorld() && PhysicsWorld::GetPhysicsWorld(parent->GetWorld()) == world)
+					bodies.push_back(body);
+			}
+			
+			world->InsertCollisionObjects(bodies);
+		}
+	}
+}
@@ -0,0 +1,68 @@
+//
+//  RBStaticBatch.h
+//  rayne-bullet
+//
+//  Copyright 2013 by Überpixel. All rights reserved.
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef __rayne_bullet__RBStaticBatch__
+#define __rayne_bullet__RBStaticBatch__
+
+#include <Rayne/Rayne.h>
+#include "RBRigidBody.h"
+
+namespace RN
+{
+	namespace bullet
+	{
+		// Merges static bodies into a single body with one broadphase proxy, the originals leave the world while the batch is in it.
+		// The batch takes the material, layer and filter of the first body, bodies that differ from it, have a contact callback,
+		// per triangle materials or a plane shape are left out and stay individual. Children keep their world transform, so the batch
+		// has to be attached to a node at the identity transform.
+		class StaticBatch : public RigidBody
+		{
+		public:
+			StaticBatch(const std::vector<RigidBody *> &bodies);
+			~StaticBatch() override;
+			
+			static StaticBatch *WithBodies(const std::vector<RigidBody *> &bodies);
+			
+			size_t GetBodyCount() const { return _bodies.size(); }
+			size_t GetMergedTriangleCount() const { return _meshTriangles; }
+			
+		protected:
+			SceneNode *GetHitNode(int part, int index) const override;
+			
+			void InsertIntoWorld(PhysicsWorld *world) override;
+			void RemoveFromWorld(PhysicsWorld *world) override;
+			
+		private:
+			void MergeMesh(RigidBody *body, const btTransform &transform);
+			
+			std::vector<RigidBody *> _bodies;
+			
+			// Compound child index to the original body, the merged mesh has none
+			std::vector<RigidBody *> _children;
+			
+			// First merged triangle of every mesh body, sorted by construction
+			std::vector<std::pair<int, RigidBody *>> _meshRanges;
+			
+			btTriangleMesh *_mesh;
+			size_t _meshTriangles;
+			
+			RNDeclareMeta(StaticBatch)
+		};
+	}
+}
+
+#endif /* defined(__rayne_bullet__RBStaticBatch__) */
@@ -0,0 +1,242 @@
+//
+//  RBTriggerVolume.cpp
+//  rayne-bullet
+//
+//  Copyright 2013 by Überpixel. All rights reserved.
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "RBTriggerVolume.h"
+#include "RBPhysicsWorld.h"
+
+namespace RN
+{
+	namespace bullet
+	{
+		RNDefineMeta(TriggerVolume, CollisionObject)
+		
+		TriggerVolume::TriggerVolume(Shape *shape, bool aabbOnly) :
+			_shape(shape->Retain()),
+			_aabbOnly(aabbOnly)
+		{
+			_ghost = new btPairCachingGhostObject();
+			_ghost->setCollisionShape(_shape->GetBulletShape());
+			_ghost->setCollisionFlags(_ghost->getCollisionFlags() | btCollisionObject::CF_NO_CONTACT_RESPONSE);
+			_ghost->setUserPointer(this);
+		}
+		
+		TriggerVolume::~TriggerVolume()
+		{
+			ClearOverlaps();
+			
+			delete _ghost;
+			_shape->Release();
+		}
+		
+		TriggerVolume *TriggerVolume::WithShape(Shape *shape, bool aabbOnly)
+		{
+			TriggerVolume *trigger = new TriggerVolume(shape, aabbOnly);
+			return trigger->Autorelease();
+		}
+		
+		
+		void TriggerVolume::SetEnterCallback(std::function<void (TriggerVolume *, CollisionObject *)> &&callback)
+		{
+			_enterCallback = std::move(callback);
+		}
+		void TriggerVolume::SetExitCallback(std::function<void (TriggerVolume *, CollisionObject *)> &&callback)
+		{
+			_exitCallback = std::move(callback);
+		}
+		void TriggerVolume::SetAABBOnly(bool aabbOnly)
+		{
+			_aabbOnly = aabbOnly;
+		}
+		
+		bool TriggerVolume::IsTrigger(const btCollisionObject *object)
+		{
+			return (object->getInternalType() == btCollisionObject::CO_GHOST_OBJECT && (object->getCollisionFlags() & btCollisionObject::CF_NO_CONTACT_RESPONSE));
+		}
+		
+		
+		void TriggerVolume::DidUpdate(SceneNode::ChangeSet changeSet)
+		{
+			CollisionObject::DidUpdate(changeSet);
+			
+			if(changeSet & SceneNode::ChangeSet::Position)
+				UpdateTransform();
+		}
+		void TriggerVolume::UpdateFromMaterial(PhysicsMaterial *material)
+		{}
+		
+		void TriggerVolume::UpdateTransform()
+		{
+			if(!GetParent())
+				return;
+			
+			Quaternion rotation = GetWorldRotation();
+			Vector3 position = GetWorldPosition() - rotation.GetRotatedVector(offset);
+			
+			_ghost->setWorldTransform(btTransform(btQuaternion(rotation.x, rotation.y, rotation.z, rotation.w), btVector3(position.x, position.y, position.z)));
+		}
+		
+		
+		void TriggerVolume::InsertIntoWorld(PhysicsWorld *world)
+		{
+			CollisionObject::InsertIntoWorld(world);
+			UpdateTransform();
+			
+			auto bulletWorld = world->GetBulletDynamicsWorld();
+			bulletWorld->addCollisionObject(_ghost, GetCollisionFilter(), GetCollisionFilterMask());
+			
+			world->_triggers.insert(this);
+		}
+		
+		void TriggerVolume::RemoveFromWorld(PhysicsWorld *world)
+		{
+			world->_triggers.erase(this);
+			
+			CollisionObject::RemoveFromWorld(world);
+			
+			auto bulletWorld = world->GetBulletDynamicsWorld();
+			bulletWorld->removeCollisionObject(_ghost);
+			
+			// Leaving the world drops the overlaps without exit events
+			ClearOverlaps();
+		}
+		
+		
+		void TriggerVolume::AddOverlap(const btCollisionObject *object)
+		{
+			if(IsTrigger(object))
+				return;
+			
+			CollisionObject *collisionObject = static_cast<CollisionObject *>(object->getUserPointer());
+			if(collisionObject)
+				_current.push_back(collisionObject);
+		}
+		
+		void TriggerVolume::UpdateOverlaps(btCollisionWorld *world)
+		{
+			_current.clear();
+			
+			if(_aabbOnly)
+			{
+				for(int i = 0; i < _ghost->getNumOverlappingObjects(); i ++)
+					AddOverlap(_ghost->getOverlappingObject(i));
+			}
+			else
+			{
+				btCollisionDispatcher *dispatcher = static_cast<btCollisionDispatcher *>(world->getDispatcher());
+				btBroadphasePairArray &pairs = _ghost->getOverlappingPairCache()->getOverlappingPairArray();
+				
+				// Only the trigger's own pairs go through the narrowphase, the world skips them entirely
+				for(int i = 0; i < pairs.size(); i ++)
+				{
+					btBroadphasePair &pair = pairs[i];
+					
+					const btCollisionObject *object0 = static_cast<btCollisionObject *>(pair.m_pProxy0->m_clientObject);
+					const btCollisionObject *object1 = static_cast<btCollisionObject *>(pair.m_pProxy1->m_clientObject);
+					
+					btCollisionObjectWrapper wrapper0(nullptr, object0->getCollisionShape(), object0, object0->getWorldTransform(), -1, -1);
+					btCollisionObjectWrapper wrapper1(nullptr, object1->getCollisionShape(), object1, object1->getWorldTransform(), -1, -1);
+					
+					if(!pair.m_algorithm)
+						pair.m_algorithm = dispatcher->findAlgorithm(&wrapper0, &wrapper1);
+					
+					if(!pair.m_algorithm)
+						continue;
+					
+					btManifoldResult result(&wrapper0, &wrapper1);
+					pair.m_algorithm->processCollision(&wrapper0, &wrapper1, world->getDispatchInfo(), &result);
+					
+					_manifolds.resize(0);
+					pair.m_algorithm->getAllContactManifolds(_manifolds);
+					
+					bool touching = false;
+					
+					for(int j = 0; j < _manifolds.size() && !touching; j ++)
+					{
+						btPersistentManifold *manifold = _manifolds[j];
+						
+						for(int k = 0; k < manifold->getNumContacts(); k ++)
+						{
+							if(manifold->getContactPoint(k).getDistance() <= 0.0f)
+							{
+								touching = true;
+								break;
+							}
+						}
+					}
+					
+					if(touching)
+						AddOverlap((object0 == _ghost) ? object1 : object0);
+				}
+			}
+			
+			std::sort(_current.begin(), _current.end());
+			_current.erase(std::unique(_current.begin(), _current.end()), _current.end());
+			
+			// Both lists are sorted, so the events fall out of a single merge
+			std::set_difference(_current.begin(), _current.end(), _overlapping.begin(), _overlapping.end(), std::back_inserter(_entered));
+			std::set_difference(_overlapping.begin(), _overlapping.end(), _current.begin(), _current.end(), std::back_inserter(_exited));
+			
+			for(CollisionObject *object : _entered)
+				object->Retain();
+			
+			_overlapping.swap(_current);
+		}
+		
+		void TriggerVolume::FireEvents()
+		{
+			// Callbacks may remove the trigger from its world, which clears the lists
+			std::vector<CollisionObject *> entered;
+			std::vector<CollisionObject *> exited;
+			
+			entered.swap(_entered);
+			exited.swap(_exited);
+			
+			for(CollisionObject *object : entered)
+			{
+				object->Retain();
+				
+				if(_enterCallback)
+					_enterCallback(this, object);
+			}
+			
+			for(CollisionObject *object : exited)
+			{
+				if(_exitCallback)
+					_exitCallback(this, object);
+			}
+			
+			for(CollisionObject *object : entered)
+				object->Release();
+			
+			for(CollisionObject *object : exited)
+				object->Release();
+		}
+		
+		void TriggerVolume::ClearOverlaps()
+		{
+			for(CollisionObject *object : _overlapping)
+				object->Release();
+			
+			for(CollisionObject *object : _exited)
+				object->Release();
+			
+			_overlapping.clear();
+			_entered.clear();
+			_exited.clear();
+		}
+	}
+}
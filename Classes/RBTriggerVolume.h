@@ -0,0 +1,86 @@
+//
+//  RBTriggerVolume.h
+//  rayne-bullet
+//
+//  Copyright 2013 by Überpixel. All rights reserved.
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef __rayne_bullet__RBTriggerVolume__
+#define __rayne_bullet__RBTriggerVolume__
+
+#include <Rayne/Rayne.h>
+#include <BulletCollision/CollisionDispatch/btGhostObject.h>
+#include "RBCollisionObject.h"
+#include "RBShape.h"
+
+namespace RN
+{
+	namespace bullet
+	{
+		class TriggerVolume : public CollisionObject
+		{
+		public:
+			friend class PhysicsWorld;
+			
+			// AABB only triggers report everything whose bounds overlap and never run the narrowphase
+			TriggerVolume(Shape *shape, bool aabbOnly = false);
+			~TriggerVolume() override;
+			
+			static TriggerVolume *WithShape(Shape *shape, bool aabbOnly = false);
+			
+			void SetEnterCallback(std::function<void (TriggerVolume *, CollisionObject *)> &&callback);
+			void SetExitCallback(std::function<void (TriggerVolume *, CollisionObject *)> &&callback);
+			void SetAABBOnly(bool aabbOnly);
+			
+			bool IsAABBOnly() const { return _aabbOnly; }
+			const std::vector<CollisionObject *> &GetOverlappingObjects() const { return _overlapping; }
+			
+			btCollisionObject *GetBulletCollisionObject() override { return _ghost; }
+			
+			static bool IsTrigger(const btCollisionObject *object);
+			
+		protected:
+			void DidUpdate(SceneNode::ChangeSet changeSet) override;
+			void UpdateFromMaterial(PhysicsMaterial *material) override;
+			
+			void InsertIntoWorld(PhysicsWorld *world) override;
+			void RemoveFromWorld(PhysicsWorld *world) override;
+			
+		private:
+			void UpdateTransform();
+			void UpdateOverlaps(btCollisionWorld *world);
+			void AddOverlap(const btCollisionObject *object);
+			void ClearOverlaps();
+			bool HasEvents() const { return (!_entered.empty() || !_exited.empty()); }
+			void FireEvents();
+			
+			Shape *_shape;
+			btPairCachingGhostObject *_ghost;
+			bool _aabbOnly;
+			
+			std::function<void (TriggerVolume *, CollisionObject *)> _enterCallback;
+			std::function<void (TriggerVolume *, CollisionObject *)> _exitCallback;
+			
+			std::vector<CollisionObject *> _overlapping;
+			std::vector<CollisionObject *> _current;
+			std::vector<CollisionObject *> _entered;
+			std::vector<CollisionObject *> _exited;
+			
+			btManifoldArray _manifolds;
+			
+			RNDeclareMeta(TriggerVolume)
+		};
+	}
+}
+
+#endif /* defined(__rayne_bullet__RBTriggerVolume__) */
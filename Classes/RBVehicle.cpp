@@ -0,0 +1,326 @@
+//
+//  RBVehicle.cpp
+//  rayne-bullet
+//
+//  Copyright 2013 by Überpixel. All rights reserved.
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "RBVehicle.h"
+#include "RBPhysicsWorld.h"
+
+namespace RN
+{
+	namespace bullet
+	{
+		RNDefineMeta(Vehicle, RigidBody)
+		
+		VehicleWheel::VehicleWheel(const Vector3 &tconnectionPoint, float tradius, float tsuspensionRestLength, bool tfront) :
+			connectionPoint(tconnectionPoint),
+			direction(Vector3(0.0f, -1.0f, 0.0f)),
+			axle(Vector3(-1.0f, 0.0f, 0.0f)),
+			radius(tradius),
+			suspensionRestLength(tsuspensionRestLength),
+			front(tfront),
+			suspensionStiffness(5.88f),
+			dampingCompression(0.83f),
+			dampingRelaxation(0.88f),
+			frictionSlip(10.5f),
+			rollInfluence(0.1f),
+			maxSuspensionTravel(5.0f),
+			maxSuspensionForce(6000.0f)
+		{}
+		
+		
+		Vehicle::Vehicle(Shape *chassis, float mass) :
+			RigidBody(chassis, mass),
+			_nextRay(0),
+			_leaf(nullptr)
+		{
+			_vehicle = new btRaycastVehicle(_tuning, GetBulletRigidBody(), this);
+			_vehicle->setCoordinateSystem(0, 1, 2);
+			
+			GetBulletRigidBody()->setActivationState(DISABLE_DEACTIVATION);
+		}
+		
+		Vehicle::~Vehicle()
+		{
+			for(SceneNode *node : _wheelNodes)
+				SafeRelease(node);
+			
+			delete _vehicle;
+		}
+		
+		Vehicle *Vehicle::WithChassis(Shape *chassis, float mass)
+		{
+			Vehicle *vehicle = new Vehicle(chassis, mass);
+			return vehicle->Autorelease();
+		}
+		
+		
+		size_t Vehicle::AddWheel(const VehicleWheel &wheel, SceneNode *node)
+		{
+			btWheelInfo &info = _vehicle->addWheel(btVector3(wheel.connectionPoint.x, wheel.connectionPoint.y, wheel.connectionPoint.z),
+												   btVector3(wheel.direction.x, wheel.direction.y, wheel.direction.z),
+												   btVector3(wheel.axle.x, wheel.axle.y, wheel.axle.z),
+												   wheel.suspensionRestLength, wheel.radius, _tuning, wheel.front);
+			
+			info.m_suspensionStiffness = wheel.suspensionStiffness;
+			info.m_wheelsDampingCompression = wheel.dampingCompression;
+			info.m_wheelsDampingRelaxation = wheel.dampingRelaxation;
+			info.m_frictionSlip = wheel.frictionSlip;
+			info.m_rollInfluence = wheel.rollInfluence;
+			info.m_maxSuspensionTravelCm = wheel.maxSuspensionTravel * 100.0f;
+			info.m_maxSuspensionForce = wheel.maxSuspensionForce;
+			
+			_wheelNodes.push_back(SafeRetain(node));
+			_rays.resize(_vehicle->getNumWheels());
+			
+			return _wheelNodes.size() - 1;
+		}
+		
+		
+		void Vehicle::SetEngineForce(size_t wheel, float force)
+		{
+			_vehicle->applyEngineForce(force, static_cast<int>(wheel));
+		}
+		void Vehicle::SetBrake(size_t wheel, float brake)
+		{
+			_vehicle->setBrake(brake, static_cast<int>(wheel));
+		}
+		void Vehicle::SetSteering(size_t wheel, float steering)
+		{
+			_vehicle->setSteeringValue(steering, static_cast<int>(wheel));
+		}
+		
+		float Vehicle::GetSteering(size_t wheel) const
+		{
+			return _vehicle->getSteeringValue(static_cast<int>(wheel));
+		}
+		float Vehicle::GetCurrentSpeed() const
+		{
+			return _vehicle->getCurrentSpeedKmHour() / 3.6f;
+		}
+		bool Vehicle::IsWheelInContact(size_t wheel) const
+		{
+			return _vehicle->getWheelInfo(static_cast<int>(wheel)).m_raycastInfo.m_isInContact;
+		}
+		
+		
+		void Vehicle::Update(float delta)
+		{
+			for(size_t i = 0; i < _wheelNodes.size(); i ++)
+			{
+				SceneNode *node = _wheelNodes[i];
+				if(!node)
+					continue;
+				
+				_vehicle->updateWheelTransform(static_cast<int>(i), true);
+				
+				const btTransform &transform = _vehicle->getWheelTransformWS(static_cast<int>(i));
+				const btVector3 &position = transform.getOrigin();
+				btQuaternion rotation = transform.getRotation();
+				
+				node->SetWorldPosition(Vector3(position.x(), position.y(), position.z()));
+				node->SetWorldRotation(Quaternion(rotation.x(), rotation.y(), rotation.z(), rotation.w()));
+			}
+		}
+		
+		
+		void Vehicle::InsertIntoWorld(PhysicsWorld *world)
+		{
+			RigidBody::InsertIntoWorld(world);
+			world->GetVehicleBatch()->AddVehicle(this);
+		}
+		
+		void Vehicle::RemoveFromWorld(PhysicsWorld *world)
+		{
+			world->GetVehicleBatch()->RemoveVehicle(this);
+			RigidBody::RemoveFromWorld(world);
+		}
+		
+		
+		void Vehicle::PrepareRays(btVector3 &aabbMin, btVector3 &aabbMax)
+		{
+			_nextRay = 0;
+			
+			aabbMin = aabbMax = GetBulletRigidBody()->getCenterOfMassPosition();
+			
+			for(int i = 0; i < _vehicle->getNumWheels(); i ++)
+			{
+				btWheelInfo &wheel = _vehicle->getWheelInfo(i);
+				_vehicle->updateWheelTransformsWS(wheel, false);
+				
+				// Same ray as btRaycastVehicle::rayCast() computes, so castRay() can match it
+				btScalar length = wheel.getSuspensionRestLength() + wheel.m_wheelsRadius;
+				btVector3 direction = wheel.m_raycastInfo.m_wheelDirectionWS * length;
+				
+				WheelRay &ray = _rays[i];
+				ray.from = wheel.m_raycastInfo.m_hardPointWS;
+				ray.to = ray.from + direction;
+				ray.fraction = 1.0f;
+				ray.object = nullptr;
+				
+				aabbMin.setMin(ray.from);
+				aabbMin.setMin(ray.to);
+				aabbMax.setMax(ray.from);
+				aabbMax.setMax(ray.to);
+			}
+		}
+		
+		void Vehicle::TestRays(btBroadphaseProxy *proxy)
+		{
+			btCollisionObject *object = static_cast<btCollisionObject *>(proxy->m_clientObject);
+			btRigidBody *body = btRigidBody::upcast(object);
+			
+			if(!body || body == GetBulletRigidBody() || !body->hasContactResponse())
+				return;
+			
+			if(!(proxy->m_collisionFilterGroup & GetCollisionFilterMask()) || !(GetCollisionFilter() & proxy->m_collisionFilterMask))
+				return;
+			
+			for(int i = 0; i < _rays.size(); i ++)
+			{
+				WheelRay &ray = _rays[i];
+				
+				btScalar fraction = ray.fraction;
+				btVector3 normal;
+				
+				if(!btRayAabb(ray.from, ray.to, proxy->m_aabbMin, proxy->m_aabbMax, fraction, normal))
+					continue;
+				
+				btCollisionWorld::ClosestRayResultCallback callback(ray.from, ray.to);
+				callback.m_closestHitFraction = ray.fraction;
+				
+				btTransform from(btQuaternion::getIdentity(), ray.from);
+				btTransform to(btQuaternion::getIdentity(), ray.to);
+				
+				btCollisionWorld::rayTestSingle(from, to, object, object->getCollisionShape(), object->getWorldTransform(), callback);
+				
+				if(callback.hasHit())
+				{
+					ray.fraction = callback.m_closestHitFraction;
+					ray.position = callback.m_hitPointWorld;
+					ray.normal = callback.m_hitNormalWorld.normalized();
+					ray.object = object;
+				}
+			}
+		}
+		
+		void *Vehicle::castRay(const btVector3 &from, const btVector3 &to, btVehicleRaycasterResult &result)
+		{
+			if(_nextRay < _rays.size())
+			{
+				const WheelRay &ray = _rays[_nextRay ++];
+				
+				if(ray.from == from && ray.to == to)
+				{
+					if(!ray.object)
+						return nullptr;
+					
+					result.m_hitPointInWorld = ray.position;
+					result.m_hitNormalInWorld = ray.normal;
+					result.m_distFraction = ray.fraction;
+					
+					return ray.object;
+				}
+			}
+			
+			// Rays that weren't part of the batched pass, ie. when updateVehicle() is called directly
+			PhysicsWorld *owner = GetOwner();
+			if(!owner)
+				return nullptr;
+			
+			btCollisionWorld::ClosestRayResultCallback callback(from, to);
+			owner->GetBulletDynamicsWorld()->rayTest(from, to, callback);
+			
+			if(callback.hasHit())
+			{
+				const btRigidBody *body = btRigidBody::upcast(callback.m_collisionObject);
+				
+				if(body && body != GetBulletRigidBody() && body->hasContactResponse())
+				{
+					result.m_hitPointInWorld = callback.m_hitPointWorld;
+					result.m_hitNormalInWorld = callback.m_hitNormalWorld.normalized();
+					result.m_distFraction = callback.m_closestHitFraction;
+					
+					return const_cast<btRigidBody *>(body);
+				}
+			}
+			
+			return nullptr;
+		}
+		
+		
+		
+		VehicleBatch::VehicleBatch(btDbvtBroadphase *broadphase) :
+			_broadphase(broadphase)
+		{}
+		
+		VehicleBatch::~VehicleBatch()
+		{
+			for(Vehicle *vehicle : _vehicles)
+				vehicle->_leaf = nullptr;
+		}
+		
+		void VehicleBatch::AddVehicle(Vehicle *vehicle)
+		{
+			btVector3 aabbMin, aabbMax;
+			vehicle->PrepareRays(aabbMin, aabbMax);
+			
+			vehicle->_leaf = _tree.insert(btDbvtVolume::FromMM(aabbMin, aabbMax), vehicle);
+			_vehicles.push_back(vehicle);
+		}
+		
+		void VehicleBatch::RemoveVehicle(Vehicle *vehicle)
+		{
+			auto iterator = std::find(_vehicles.begin(), _vehicles.end(), vehicle);
+			if(iterator == _vehicles.end())
+				return;
+			
+			*iterator = _vehicles.back();
+			_vehicles.pop_back();
+			
+			_tree.remove(vehicle->_leaf);
+			vehicle->_leaf = nullptr;
+		}
+		
+		void VehicleBatch::updateAction(btCollisionWorld *world, btScalar step)
+		{
+			if(_vehicles.empty())
+				return;
+			
+			for(Vehicle *vehicle : _vehicles)
+			{
+				btVector3 aabbMin, aabbMax;
+				vehicle->PrepareRays(aabbMin, aabbMax);
+				
+				btDbvtVolume volume = btDbvtVolume::FromMM(aabbMin, aabbMax);
+				_tree.update(vehicle->_leaf, volume);
+			}
+			
+			// One traversal of the dynamic and the static broadphase tree against the bounds of all wheel rays
+			Collider collider;
+			_tree.collideTT(_tree.m_root, _broadphase->m_sets[0].m_root, collider);
+			_tree.collideTT(_tree.m_root, _broadphase->m_sets[1].m_root, collider);
+			
+			for(Vehicle *vehicle : _vehicles)
+				vehicle->_vehicle->updateVehicle(step);
+		}
+		
+		void VehicleBatch::Collider::Process(const btDbvtNode *vehicleLeaf, const btDbvtNode *proxyLeaf)
+		{
+			Vehicle *vehicle = static_cast<Vehicle *>(vehicleLeaf->data);
+			vehicle->TestRays(static_cast<btDbvtProxy *>(proxyLeaf->data));
+		}
+	}
+}
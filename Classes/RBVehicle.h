@@ -0,0 +1,138 @@
+//
+//  RBVehicle.h
+//  rayne-bullet
+//
+//  Copyright 2013 by Überpixel. All rights reserved.
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef __rayne_bullet__RBVehicle__
+#define __rayne_bullet__RBVehicle__
+
+#include <Rayne/Rayne.h>
+#include <BulletDynamics/Vehicle/btRaycastVehicle.h>
+#include <BulletCollision/BroadphaseCollision/btDbvtBroadphase.h>
+#include "RBRigidBody.h"
+
+namespace RN
+{
+	namespace bullet
+	{
+		class VehicleBatch;
+		
+		struct VehicleWheel
+		{
+			VehicleWheel(const Vector3 &connectionPoint, float radius, float suspensionRestLength, bool front);
+			
+			// Connection point, suspension direction and axle in chassis space
+			Vector3 connectionPoint;
+			Vector3 direction;
+			Vector3 axle;
+			
+			float radius;
+			float suspensionRestLength;
+			bool front;
+			
+			float suspensionStiffness;
+			float dampingCompression;
+			float dampingRelaxation;
+			float frictionSlip;
+			float rollInfluence;
+			float maxSuspensionTravel;
+			float maxSuspensionForce;
+		};
+		
+		class Vehicle : public RigidBody, public btVehicleRaycaster
+		{
+		public:
+			friend class VehicleBatch;
+			
+			Vehicle(Shape *chassis, float mass);
+			~Vehicle() override;
+			
+			static Vehicle *WithChassis(Shape *chassis, float mass);
+			
+			size_t AddWheel(const VehicleWheel &wheel, SceneNode *node = nullptr);
+			
+			void SetEngineForce(size_t wheel, float force);
+			void SetBrake(size_t wheel, float brake);
+			void SetSteering(size_t wheel, float steering);
+			
+			float GetSteering(size_t wheel) const;
+			float GetCurrentSpeed() const;
+			bool IsWheelInContact(size_t wheel) const;
+			size_t GetWheelCount() const { return _wheelNodes.size(); }
+			
+			void Update(float delta) override;
+			
+			btRaycastVehicle *GetBulletVehicle() { return _vehicle; }
+			
+		protected:
+			void InsertIntoWorld(PhysicsWorld *world) override;
+			void RemoveFromWorld(PhysicsWorld *world) override;
+			
+		private:
+			struct WheelRay
+			{
+				btVector3 from;
+				btVector3 to;
+				btVector3 position;
+				btVector3 normal;
+				btScalar fraction;
+				btCollisionObject *object;
+			};
+			
+			void *castRay(const btVector3 &from, const btVector3 &to, btVehicleRaycasterResult &result) override;
+			
+			void PrepareRays(btVector3 &aabbMin, btVector3 &aabbMax);
+			void TestRays(btBroadphaseProxy *proxy);
+			
+			btRaycastVehicle::btVehicleTuning _tuning;
+			btRaycastVehicle *_vehicle;
+			
+			std::vector<SceneNode *> _wheelNodes;
+			btAlignedObjectArray<WheelRay> _rays;
+			int _nextRay;
+			
+			btDbvtNode *_leaf;
+			
+			RNDeclareMeta(Vehicle)
+		};
+		
+		// Steps all vehicles of a world as one action and performs their wheel raycasts in a single broadphase pass
+		class VehicleBatch : public btActionInterface
+		{
+		public:
+			VehicleBatch(btDbvtBroadphase *broadphase);
+			~VehicleBatch() override;
+			
+			void AddVehicle(Vehicle *vehicle);
+			void RemoveVehicle(Vehicle *vehicle);
+			
+			void updateAction(btCollisionWorld *world, btScalar step) override;
+			void debugDraw(btIDebugDraw *drawer) override {}
+			
+		private:
+			struct Collider : btDbvt::ICollide
+			{
+				void Process(const btDbvtNode *vehicleLeaf, const btDbvtNode *proxyLeaf);
+			};
+			
+			btDbvtBroadphase *_broadphase;
+			btDbvt _tree;
+			
+			std::vector<Vehicle *> _vehicles;
+		};
+	}
+}
+
+#endif /* defined(__rayne_bullet__RBVehicle__) */
@@ -0,0 +1,298 @@
+//
+//  RBWorldPartition.cpp
+//  rayne-bullet
+//
+//  Copyright 2013 by Überpixel. All rights reserved.
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "RBWorldPartition.h"
+#include "RBPhysicsWorld.h"
+
+namespace RN
+{
+	namespace bullet
+	{
+		RNDefineMeta(WorldPartition, Object)
+		
+		WorldPartition::WorldPartition(PhysicsWorld *world, float cellSize, CellLoader &&loader) :
+			_world(world->Retain()),
+			_cellSize(cellSize),
+			_loadRadius(cellSize * 2.0f),
+			_memoryBudget(std::numeric_limits<size_t>::max()),
+			_residentMemory(0),
+			_residentCount(0),
+			_loadingCount(0),
+			_loader(std::move(loader))
+		{}
+		
+		WorldPartition::~WorldPartition()
+		{
+			// Loads in flight still write into their cells
+			for(PendingBatch &pending : _batches)
+			{
+				pending.batch->Wait();
+				pending.batch->Release();
+			}
+			
+			std::vector<CollisionObject *> bodies;
+			
+			for(auto &pair : _cells)
+			{
+				if(pair.second->body)
+					bodies.push_back(pair.second->body);
+			}
+			
+			if(!bodies.empty())
+				_world->RemoveCollisionObjects(bodies);
+			
+			for(auto &pair : _cells)
+				DestroyCell(pair.second);
+			
+			if(_world->GetWorldPartition() == this)
+				_world->SetWorldPartition(nullptr);
+			
+			_world->Release();
+		}
+		
+		
+		void WorldPartition::SetFocusPoints(const std::vector<Vector3> &points)
+		{
+			_focusPoints = points;
+		}
+		void WorldPartition::SetLoadRadius(float radius)
+		{
+			_loadRadius = radius;
+		}
+		void WorldPartition::SetMemoryBudget(size_t budget)
+		{
+			_memoryBudget = budget;
+		}
+		
+		
+		float WorldPartition::GetDistance(const Cell *cell) const
+		{
+			float centerX = (cell->x + 0.5f) * _cellSize;
+			float centerZ = (cell->z + 0.5f) * _cellSize;
+			
+			float distance = std::numeric_limits<float>::max();
+			
+			for(const Vector3 &point : _focusPoints)
+			{
+				float dx = point.x - centerX;
+				float dz = point.z - centerZ;
+				
+				distance = std::min(distance, std::sqrt(dx * dx + dz * dz));
+			}
+			
+			return distance;
+		}
+		
+		void WorldPartition::DestroyCell(Cell *cell)
+		{
+			SafeRelease(cell->body);
+			SafeRelease(cell->node);
+			SafeRelease(cell->data.shape);
+			
+			delete cell;
+		}
+		
+		void WorldPartition::UpdateWantedCells()
+		{
+			for(auto &pair : _cells)
+				pair.second->wanted = false;
+			
+			// Cells are wanted when their center lies within the radius of any focus point
+			int32 reach = static_cast<int32>(std::ceil(_loadRadius / _cellSize));
+			
+			std::vector<Cell *> loads;
+			
+			for(const Vector3 &point : _focusPoints)
+			{
+				int32 originX = static_cast<int32>(std::floor(point.x / _cellSize));
+				int32 originZ = static_cast<int32>(std::floor(point.z / _cellSize));
+				
+				for(int32 x = originX - reach; x <= originX + reach; x ++)
+				{
+					for(int32 z = originZ - reach; z <= originZ + reach; z ++)
+					{
+						float dx = point.x - (x + 0.5f) * _cellSize;
+						float dz = point.z - (z + 0.5f) * _cellSize;
+						
+						if(dx * dx + dz * dz > _loadRadius * _loadRadius)
+							continue;
+						
+						Cell *&cell = _cells[GetKey(x, z)];
+						
+						if(!cell)
+						{
+							cell = new Cell();
+							cell->x = x;
+							cell->z = z;
+							cell->state.store(State::Loading);
+							cell->node = nullptr;
+							cell->body = nullptr;
+							
+							loads.push_back(cell);
+						}
+						
+						cell->wanted = true;
+					}
+				}
+			}
+			
+			if(loads.empty())
+				return;
+			
+			PendingBatch pending;
+			pending.batch = ThreadPool::GetSharedInstance()->CreateBatch();
+			pending.remaining = std::make_shared<std::atomic<size_t>>(loads.size());
+			
+			for(Cell *cell : loads)
+			{
+				std::shared_ptr<std::atomic<size_t>> remaining = pending.remaining;
+				CellLoader &loader = _loader;
+				
+				pending.batch->AddTask([cell, remaining, &loader] {
+					
+					cell->data = loader(cell->x, cell->z);
+					cell->state.store(State::Loaded, std::memory_order_release);
+					
+					remaining->fetch_sub(1, std::memory_order_release);
+					
+				});
+			}
+			
+			pending.batch->Commit();
+			
+			_batches.push_back(pending);
+			_loadingCount += loads.size();
+		}
+		
+		void WorldPartition::Update()
+		{
+			UpdateWantedCells();
+			
+			_batches.erase(std::remove_if(_batches.begin(), _batches.end(), [](PendingBatch &pending) {
+				
+				if(pending.remaining->load(std::memory_order_acquire) > 0)
+					return false;
+				
+				pending.batch->Release();
+				return true;
+				
+			}), _batches.end());
+			
+			std::vector<CollisionObject *> insertions;
+			std::vector<CollisionObject *> removals;
+			std::vector<Cell *> resident;
+			std::vector<Cell *> discarded;
+			
+			for(auto &pair : _cells)
+			{
+				Cell *cell = pair.second;
+				State state = cell->state.load(std::memory_order_acquire);
+				
+				switch(state)
+				{
+					case State::Loading:
+						break;
+						
+					case State::Loaded:
+					{
+						_loadingCount --;
+						
+						// Cells that were left behind while loading are dropped right away
+						if(!cell->wanted)
+						{
+							discarded.push_back(cell);
+							break;
+						}
+						
+						cell->state.store(State::Resident);
+						_residentCount ++;
+						
+						if(!cell->data.shape)
+							break;
+						
+						cell->node = new SceneNode();
+						cell->node->SetPosition(Vector3(cell->x * _cellSize, 0.0f, cell->z * _cellSize));
+						
+						// The node isn't part of a scene, so attaching doesn't insert the body and it waits for the batched insertion
+						cell->body = new RigidBody(cell->data.shape, 0.0f);
+						cell->node->AddAttachment(cell->body);
+						
+						insertions.push_back(cell->body);
+						
+						_residentMemory += cell->data.memory;
+						break;
+					}
+						
+					case State::Resident:
+						if(!cell->wanted && !cell->body)
+						{
+							_residentCount --;
+							discarded.push_back(cell);
+							break;
+						}
+						
+						resident.push_back(cell);
+						break;
+				}
+			}
+			
+			// Evict the farthest cells that are no longer wanted until the budget fits again
+			if(_residentMemory > _memoryBudget)
+			{
+				std::vector<std::pair<float, Cell *>> candidates;
+				
+				for(Cell *cell : resident)
+				{
+					if(!cell->wanted)
+						candidates.emplace_back(GetDistance(cell), cell);
+				}
+				
+				std::sort(candidates.begin(), candidates.end(), [](const std::pair<float, Cell *> &a, const std::pair<float, Cell *> &b) {
+					return (a.first > b.first);
+				});
+				
+				for(auto &candidate : candidates)
+				{
+					if(_residentMemory <= _memoryBudget)
+						break;
+					
+					Cell *cell = candidate.second;
+					
+					if(cell->body)
+						removals.push_back(cell->body);
+					
+					_residentMemory -= cell->data.memory;
+					_residentCount --;
+					
+					discarded.push_back(cell);
+				}
+			}
+			
+			if(!removals.empty())
+				_world->RemoveCollisionObjects(removals);
+			
+			if(!insertions.empty())
+				_world->InsertCollisionObjects(insertions);
+			
+			for(Cell *cell : discarded)
+			{
+				_cells.erase(GetKey(cell->x, cell->z));
+				DestroyCell(cell);
+			}
+		}
+	}
+}
@@ -0,0 +1,118 @@
+//
+//  RBWorldPartition.h
+//  rayne-bullet
+//
+//  Copyright 2013 by Überpixel. All rights reserved.
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+//  documentation files (the "Software"), to deal in the Software without restriction, including without limitation
+//  the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+//  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+//  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+//  FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+//  ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef __rayne_bullet__RBWorldPartition__
+#define __rayne_bullet__RBWorldPartition__
+
+#include <Rayne/Rayne.h>
+#include <atomic>
+#include "RBRigidBody.h"
+#include "RBShape.h"
+
+namespace RN
+{
+	namespace bullet
+	{
+		class PhysicsWorld;
+		
+		// Streams static collision in square cells on the XZ plane around a set of focus points, not thread safe apart from the loader
+		class WorldPartition : public Object
+		{
+		public:
+			struct CellData
+			{
+				CellData() :
+					shape(nullptr),
+					memory(0)
+				{}
+				
+				// Owned by the partition from here on, positioned relative to the minimum corner of the cell
+				Shape *shape;
+				size_t memory;
+			};
+			
+			// Called on a worker thread, an empty result marks a cell without collision
+			typedef std::function<CellData (int32 x, int32 z)> CellLoader;
+			
+			WorldPartition(PhysicsWorld *world, float cellSize, CellLoader &&loader);
+			~WorldPartition() override;
+			
+			void SetFocusPoints(const std::vector<Vector3> &points);
+			void SetLoadRadius(float radius);
+			void SetMemoryBudget(size_t budget);
+			
+			// Inserts finished cells and evicts distant ones, has to be called from the game thread as it creates scene nodes
+			void Update();
+			
+			float GetCellSize() const { return _cellSize; }
+			size_t GetResidentMemory() const { return _residentMemory; }
+			size_t GetResidentCellCount() const { return _residentCount; }
+			size_t GetLoadingCellCount() const { return _loadingCount; }
+			
+		private:
+			enum class State : uint8
+			{
+				Loading,
+				Loaded,
+				Resident
+			};
+			
+			struct Cell
+			{
+				int32 x;
+				int32 z;
+				
+				std::atomic<State> state;
+				bool wanted;
+				
+				CellData data;
+				SceneNode *node;
+				RigidBody *body;
+			};
+			
+			struct PendingBatch
+			{
+				ThreadPool::Batch *batch;
+				std::shared_ptr<std::atomic<size_t>> remaining;
+			};
+			
+			static uint64 GetKey(int32 x, int32 z) { return (static_cast<uint64>(static_cast<uint32>(x)) << 32) | static_cast<uint32>(z); }
+			float GetDistance(const Cell *cell) const;
+			
+			void UpdateWantedCells();
+			void DestroyCell(Cell *cell);
+			
+			PhysicsWorld *_world;
+			float _cellSize;
+			float _loadRadius;
+			size_t _memoryBudget;
+			
+			size_t _residentMemory;
+			size_t _residentCount;
+			size_t _loadingCount;
+			
+			CellLoader _loader;
+			std::vector<Vector3> _focusPoints;
+			std::unordered_map<uint64, Cell *> _cells;
+			std::vector<PendingBatch> _batches;
+			
+			RNDeclareMeta(WorldPartition)
+		};
+	}
+}
+
+#endif /* defined(__rayne_bullet__RBWorldPartition__) */